@@ -0,0 +1,571 @@
+#include "flow.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Benchmark suite for the build and query paths.
+//
+// Generates synthetic maps, builds them with every storage and a few layer
+// counts, and prints one JSON object with a flat record per run so results can
+// be diffed between commits. Compiled with -DFLOW_BUILD_STATS, records also
+// carry the work counters of the breadth first build.
+//
+// Rebuilds of a layer, in every single-layer build mode and in one multi-layer
+// traversal, must not allocate once the build workspace has grown.
+// The suite counts the heap allocations of a rebuild and fails if any is made.
+//
+// Usage: benchSuite [--sizes 64,256,1024,4096,8192] [--maps open,maze,lanes,dense] [--out file.json]
+
+namespace {
+
+// Heap allocations of the process, counted by the operator new below
+std::atomic<uint64_t> allocationCount(0);
+
+// Allocations made by steady state rebuilds, over every run
+uint64_t rebuildAllocations = 0;
+
+} // namespace
+
+// Kept out of line: once inlined, GCC sees free() called on memory from operator new and warns (-Wmismatched-new-delete)
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+void * operator new (size_t size) {
+    ++allocationCount;
+    if (void * memory = std::malloc(size != 0 ? size : 1))
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+void * operator new[] (size_t size) {
+    return operator new(size);
+}
+
+NOINLINE void operator delete (void * memory) noexcept {
+    std::free(memory);
+}
+
+NOINLINE void operator delete[] (void * memory) noexcept {
+    std::free(memory);
+}
+
+NOINLINE void operator delete (void * memory, size_t) noexcept {
+    std::free(memory);
+}
+
+NOINLINE void operator delete[] (void * memory, size_t) noexcept {
+    std::free(memory);
+}
+
+#undef NOINLINE
+
+namespace {
+
+const uint8_t OPEN = flow::Directions::NORTH | flow::Directions::EAST | flow::Directions::SOUTH | flow::Directions::WEST;
+const uint8_t DIAGONAL = 0x10; // Access bit 4, see FieldCell
+
+/// Access bytes of a square map, in the bit layout of the planar access plane
+struct Map {
+    std::string name;
+    uint16_t size;
+    std::vector<uint8_t> access;
+    std::vector<std::array<uint16_t, 2>> poi;
+};
+
+/// Every cell passable, diagonal moves allowed
+void openMap (Map& map, std::mt19937&) {
+    std::fill(map.access.begin(), map.access.end(), OPEN | DIAGONAL);
+}
+
+/// Perfect maze with 1 cell corridors (randomized depth-first search over the odd cells)
+void mazeMap (Map& map, std::mt19937& rng) {
+    const size_t size = map.size;
+    const size_t rooms = (size - 1) / 2;
+    std::fill(map.access.begin(), map.access.end(), 0);
+    if (rooms == 0)
+        return;
+
+    std::vector<uint8_t> visited(rooms * rooms, 0);
+    std::vector<size_t> stack(1, 0);
+    visited[0] = 1;
+    map.access[1 * size + 1] = OPEN;
+
+    const int dx[4] = {0, 1, 0, -1};
+    const int dy[4] = {-1, 0, 1, 0};
+
+    while (!stack.empty()) {
+        const size_t room = stack.back();
+        const long rx = room % rooms, ry = room / rooms;
+
+        int options[4], count = 0;
+        for (int d = 0; d < 4; ++d) {
+            const long nx = rx + dx[d], ny = ry + dy[d];
+            if (nx >= 0 && ny >= 0 && nx < (long)rooms && ny < (long)rooms && !visited[ny * rooms + nx])
+                options[count++] = d;
+        }
+
+        if (count == 0) {
+            stack.pop_back();
+            continue;
+        }
+
+        const int d = options[rng() % count];
+        const size_t nx = rx + dx[d], ny = ry + dy[d];
+        visited[ny * rooms + nx] = 1;
+        map.access[(2 * ry + 1 + dy[d]) * size + 2 * rx + 1 + dx[d]] = OPEN;
+        map.access[(2 * ny + 1) * size + 2 * nx + 1] = OPEN;
+        stack.push_back(ny * rooms + nx);
+    }
+}
+
+/// Open rows every 8 rows, joined by one-way lanes like the '1' and '4' lanes of the example
+void lanesMap (Map& map, std::mt19937&) {
+    const size_t size = map.size;
+    for (size_t y = 0; y < size; ++y) {
+        for (size_t x = 0; x < size; ++x) {
+            uint8_t access = 0;
+            if (y % 8 == 0)
+                access = OPEN | DIAGONAL;
+            else if (x % 4 == 1)
+                access = flow::Directions::SOUTH;
+            else if (x % 4 == 3)
+                access = flow::Directions::NORTH;
+
+            map.access[y * size + x] = access;
+        }
+    }
+}
+
+/// 40% walls scattered at random
+void denseMap (Map& map, std::mt19937& rng) {
+    for (auto& access : map.access)
+        access = rng() % 100 < 40 ? 0 : OPEN | DIAGONAL;
+}
+
+struct Generator {
+    const char * name;
+    void (*generate) (Map&, std::mt19937&);
+};
+
+const Generator generators[] = {
+    {"open", openMap},
+    {"maze", mazeMap},
+    {"lanes", lanesMap},
+    {"dense", denseMap},
+};
+
+Map generate (const Generator& generator, uint16_t size) {
+    std::mt19937 rng(size);
+    Map map;
+    map.name = generator.name;
+    map.size = size;
+    map.access.assign((size_t)size * size, 0);
+    generator.generate(map, rng);
+
+    // Points of interest on passable cells near the center and a corner
+    const std::array<uint16_t, 2> wanted[2] = {{{(uint16_t)(size / 2), (uint16_t)(size / 2)}}, {{1, 1}}};
+    for (auto point : wanted) {
+        size_t idx = (size_t)point[1] * size + point[0];
+        while (idx + 1 < map.access.size() && map.access[idx] == 0)
+            ++idx;
+        map.poi.push_back({{(uint16_t)(idx % size), (uint16_t)(idx / size)}});
+    }
+
+    return map;
+}
+
+template <typename FieldType>
+void loadMap (FieldType& field, const Map& map) {
+    for (auto cell = field.begin(); cell != field.end(); ++cell) {
+        cell->setEntryDir(map.access[cell.idx] & 0xF);
+        cell->setAllowDiagonal((map.access[cell.idx] & DIAGONAL) != 0);
+    }
+}
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedNs (Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+/// Median time of `repeat` runs, in nanoseconds
+template <typename Fn>
+double medianNs (Fn fn, int repeat) {
+    std::vector<double> samples;
+    for (int i = 0; i < repeat; ++i) {
+        const auto start = Clock::now();
+        fn();
+        samples.push_back(elapsedNs(start));
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+/// Heap allocations made by fn
+template <typename Fn>
+uint64_t allocationsOf (Fn fn) {
+    const uint64_t before = allocationCount.load();
+    fn();
+    return allocationCount.load() - before;
+}
+
+volatile uint32_t sink;
+
+/// One JSON record: a flat object of string and number fields
+class Record {
+public:
+    Record& add (const std::string& key, const std::string& value) {
+        fields.push_back("\"" + key + "\": \"" + value + "\"");
+        return *this;
+    }
+
+    Record& add (const std::string& key, double value) {
+        std::ostringstream out;
+        out << "\"" << key << "\": " << value;
+        fields.push_back(out.str());
+        return *this;
+    }
+
+    std::string str () const {
+        std::string out = "{";
+        for (size_t i = 0; i < fields.size(); ++i)
+            out += (i ? ", " : "") + fields[i];
+        return out + "}";
+    }
+
+private:
+    std::vector<std::string> fields;
+};
+
+template <typename FieldType>
+Record run (const Map& map, const char * storage, size_t layers) {
+    const size_t cells = (size_t)map.size * map.size;
+    const int buildRepeat = (int)std::max<size_t>(1, std::min<size_t>(5, ((size_t)1 << 22) / cells));
+    const size_t queryCount = 1 << 16;
+
+    FieldType field(map.size, map.size);
+    const double loadCellsNs = medianNs([&] { loadMap(field, map); }, 3);
+    const double loadBulkNs = medianNs([&] { field.loadAccess(map.access.data()); }, 3);
+
+    typename FieldType::PointOfInterests poi;
+    for (auto point : map.poi)
+        poi.push_back({point[0], point[1]});
+
+    const double bfsNs = medianNs([&] { field.addPointOfInterest(0, poi); }, buildRepeat);
+    const double weightedNs = medianNs([&] { field.addPointOfInterest(0, poi, flow::BuildModes::WEIGHTED); }, buildRepeat);
+    const double bitboardNs = medianNs([&] { field.addPointOfInterest(0, poi, flow::BuildModes::BITBOARD); }, buildRepeat);
+    const double eikonalNs = medianNs([&] { field.addPointOfInterest(0, poi, flow::BuildModes::EIKONAL); }, buildRepeat);
+
+    // The builds above have grown the workspace of this thread, so these rebuilds reuse it
+    const uint64_t bfsAllocations = allocationsOf([&] { field.addPointOfInterest(0, poi); });
+    const uint64_t weightedAllocations = allocationsOf([&] { field.addPointOfInterest(0, poi, flow::BuildModes::WEIGHTED); });
+    const uint64_t bitboardAllocations = allocationsOf([&] { field.addPointOfInterest(0, poi, flow::BuildModes::BITBOARD); });
+    const uint64_t eikonalAllocations = allocationsOf([&] { field.addPointOfInterest(0, poi, flow::BuildModes::EIKONAL); });
+    rebuildAllocations += bfsAllocations + weightedAllocations + bitboardAllocations + eikonalAllocations;
+
+    // Every layer, each with its own point of interest, built one by one and in one traversal
+    typename FieldType::LayerPointOfInterests layerPoi;
+    for (size_t layer = 0; layer < layers; ++layer) {
+        const auto point = map.poi[layer % map.poi.size()];
+        layerPoi.push_back({layer, {{point[0], point[1]}}});
+    }
+
+    const double layersSeparateNs = medianNs([&] {
+        for (const auto& entry : layerPoi)
+            field.addPointOfInterest(entry.first, entry.second);
+    }, buildRepeat);
+    const double layersSharedNs = medianNs([&] { field.addPointOfInterest(layerPoi); }, buildRepeat);
+    const uint64_t layersSharedAllocations = allocationsOf([&] { field.addPointOfInterest(layerPoi); });
+    rebuildAllocations += layersSharedAllocations;
+
+    // A crowd at random positions splatted into congestion costs, and layer 0 rebuilt with them
+    const size_t crowdCount = 50000;
+    std::mt19937 crowdRng(11);
+    std::vector<float> crowdX(crowdCount), crowdY(crowdCount);
+    for (size_t i = 0; i < crowdCount; ++i) {
+        crowdX[i] = (crowdRng() % map.size) + 0.5f;
+        crowdY[i] = (crowdRng() % map.size) + 0.5f;
+    }
+
+    flow::CongestionField<FieldType> congestion(field);
+    congestion.track(0, poi);
+    const double splatNs = medianNs([&] {
+        congestion.clear();
+        congestion.splat(crowdCount, crowdX.data(), crowdY.data());
+    }, 5);
+    const double congestionUpdateNs = medianNs([&] { congestion.update(); }, 1);
+
+    // The crowd walking at random, one tick per frame: splat, cost rewrites and a slice of the rebuild of layer 0
+    // behind layer 1, until the rebuild is published. The longest tick must fit in a 16 ms frame
+    const size_t sliceCells = 1 << 15;
+    double congestionTickNs = 0;
+    size_t congestionTicks = 0;
+    if (layers > 1) {
+        flow::CongestionField<FieldType> sliced(field);
+        sliced.track(0, 1, poi);
+
+        size_t published = 0;
+        while (published == 0 && congestionTicks < 4 * cells / sliceCells + 16) {
+            for (size_t i = 0; i < crowdCount; ++i) {
+                crowdX[i] = std::min(std::max(crowdX[i] + (int)(crowdRng() % 3) - 1, 0.5f), map.size - 0.5f);
+                crowdY[i] = std::min(std::max(crowdY[i] + (int)(crowdRng() % 3) - 1, 0.5f), map.size - 0.5f);
+            }
+
+            const auto start = Clock::now();
+            sliced.clear();
+            sliced.splat(crowdCount, crowdX.data(), crowdY.data());
+            published = sliced.update(0, sliceCells);
+            congestionTickNs = std::max(congestionTickNs, elapsedNs(start));
+            ++congestionTicks;
+        }
+    }
+
+    field.addPointOfInterest(0, poi);
+
+    // Random query coordinates, the same for every query path
+    std::mt19937 rng(7);
+    std::vector<uint16_t> x(queryCount), y(queryCount), nX(queryCount), nY(queryCount);
+    std::vector<float> vX(queryCount), vY(queryCount);
+    for (size_t i = 0; i < queryCount; ++i) {
+        x[i] = rng() % map.size;
+        y[i] = rng() % map.size;
+    }
+
+    const double directionNs = medianNs([&] {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < queryCount; ++i)
+            sum += field.getDirection(0, x[i], y[i]);
+        sink = sum;
+    }, 5) / queryCount;
+
+    const double nextCellNs = medianNs([&] {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < queryCount; ++i) {
+            uint16_t cx, cy;
+            field.getNextCell(0, x[i], y[i], &cx, &cy);
+            sum += cx + cy;
+        }
+        sink = sum;
+    }, 5) / queryCount;
+
+    const double directionsBatchNs = medianNs([&] {
+        field.getDirections(0, queryCount, x.data(), y.data(), vX.data(), vY.data());
+        sink = (uint32_t)vX[queryCount - 1];
+    }, 5) / queryCount;
+
+    const double nextCellsBatchNs = medianNs([&] {
+        field.getNextCells(0, queryCount, x.data(), y.data(), nX.data(), nY.data());
+        sink = nX[queryCount - 1];
+    }, 5) / queryCount;
+
+    // One agent per query coordinate, moving one cell per step
+    std::vector<float> agentX(queryCount), agentY(queryCount), agentSpeed(queryCount, 1.0f);
+    std::vector<size_t> arrived;
+    auto crowdStepNs = [&](size_t sortInterval) {
+        for (size_t i = 0; i < queryCount; ++i) {
+            agentX[i] = x[i] + 0.5f;
+            agentY[i] = y[i] + 0.5f;
+        }
+
+        flow::CrowdStepper<FieldType> crowd(field);
+        crowd.sortInterval(sortInterval);
+        return medianNs([&] {
+            sink = crowd.step(0, queryCount, agentX.data(), agentY.data(), agentSpeed.data(), arrived);
+        }, 5) / queryCount;
+    };
+
+    const double crowdSortedNs = crowdStepNs(8);
+    const double crowdUnsortedNs = crowdStepNs(0);
+
+    Record record;
+    record.add("map", map.name)
+          .add("size", map.size)
+          .add("cells", cells)
+          .add("storage", storage)
+          .add("layers", layers)
+          .add("memory_bytes_per_cell", (double)field.memoryUsage() / cells)
+          .add("load_cells_ms", loadCellsNs / 1e6)
+          .add("load_bulk_ms", loadBulkNs / 1e6)
+          .add("build_bfs_ms", bfsNs / 1e6)
+          .add("build_bfs_cells_per_sec", cells / (bfsNs / 1e9))
+          .add("build_weighted_ms", weightedNs / 1e6)
+          .add("build_weighted_cells_per_sec", cells / (weightedNs / 1e9))
+          .add("build_bfs_allocations", bfsAllocations)
+          .add("build_weighted_allocations", weightedAllocations)
+          .add("build_bitboard_allocations", bitboardAllocations)
+          .add("build_eikonal_allocations", eikonalAllocations)
+          .add("build_layers_shared_allocations", layersSharedAllocations)
+          .add("build_bitboard_ms", bitboardNs / 1e6)
+          .add("build_bitboard_cells_per_sec", cells / (bitboardNs / 1e9))
+          .add("build_eikonal_ms", eikonalNs / 1e6)
+          .add("build_eikonal_cells_per_sec", cells / (eikonalNs / 1e9))
+          .add("build_layers_separate_ms", layersSeparateNs / 1e6)
+          .add("build_layers_shared_ms", layersSharedNs / 1e6)
+          .add("congestion_splat_ms", splatNs / 1e6)
+          .add("congestion_update_ms", congestionUpdateNs / 1e6)
+          .add("get_direction_ns", directionNs)
+          .add("get_next_cell_ns", nextCellNs)
+          .add("get_directions_batch_ns", directionsBatchNs)
+          .add("get_next_cells_batch_ns", nextCellsBatchNs)
+          .add("crowd_step_ns", crowdSortedNs)
+          .add("crowd_step_unsorted_ns", crowdUnsortedNs);
+
+    if (layers > 1)
+        record.add("congestion_tick_ms", congestionTickNs / 1e6)
+              .add("congestion_rebuild_ticks", congestionTicks);
+
+#ifdef FLOW_BUILD_STATS
+    // Work done by the breadth first build above
+    const auto& stats = field.buildStats(0);
+    record.add("bfs_cells_visited", stats.cellsVisited)
+          .add("bfs_cells_enqueued", stats.cellsEnqueued)
+          .add("bfs_peak_queue_depth", stats.peakQueueDepth)
+          .add("bfs_walls_marked", stats.wallsMarked)
+          .add("bfs_unreachable_cells", stats.unreachableCells);
+#endif
+
+    return record;
+}
+
+/// Breadth-first build of a disk-backed field keeping `residentTiles` of its tiles in memory
+Record runStreamed (const Map& map, size_t residentTiles) {
+    const size_t cells = (size_t)map.size * map.size;
+    const int buildRepeat = (int)std::max<size_t>(1, std::min<size_t>(5, ((size_t)1 << 22) / cells));
+
+    // The scratch file is removed from the directory as soon as it is opened
+    flow::StreamedLayeredField<1, 64> field(map.size, map.size, "benchSuite.tiles", residentTiles);
+    field.loadAccess(map.access.data());
+
+    flow::StreamedLayeredField<1, 64>::PointOfInterests poi;
+    for (auto point : map.poi)
+        poi.push_back({point[0], point[1]});
+
+    const double bfsNs = medianNs([&] { field.addPointOfInterest(0, poi); }, buildRepeat);
+
+    Record record;
+    record.add("map", map.name)
+          .add("size", map.size)
+          .add("cells", cells)
+          .add("storage", "streamed64")
+          .add("layers", 1)
+          .add("resident_tiles", residentTiles)
+          .add("memory_bytes_per_cell", (double)field.memoryUsage() / cells)
+          .add("build_bfs_ms", bfsNs / 1e6)
+          .add("build_bfs_cells_per_sec", cells / (bfsNs / 1e9));
+
+    return record;
+}
+
+std::vector<std::string> split (const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+const char * simdLevel () {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE4_1__)
+    return "sse4.1";
+#else
+    return "none";
+#endif
+}
+
+} // namespace
+
+int main (int argc, char ** argv) {
+    std::vector<std::string> sizes = split("64,256,1024,4096");
+    std::vector<std::string> maps;
+    std::string outPath;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string option = argv[i];
+        if (option == "--sizes")
+            sizes = split(argv[i + 1]);
+        else if (option == "--maps")
+            maps = split(argv[i + 1]);
+        else if (option == "--out")
+            outPath = argv[i + 1];
+        else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Record> records;
+    for (const auto& sizeText : sizes) {
+        const uint16_t size = (uint16_t)std::atoi(sizeText.c_str());
+
+        for (const auto& generator : generators) {
+            if (!maps.empty() && std::find(maps.begin(), maps.end(), generator.name) == maps.end())
+                continue;
+
+            const Map map = generate(generator, size);
+            std::cerr << generator.name << " " << size << "x" << size << std::endl;
+
+            records.push_back(run<flow::LayeredField<1>>(map, "aos", 1));
+            records.push_back(run<flow::LayeredField<4>>(map, "aos", 4));
+            records.push_back(run<flow::LayeredField<16>>(map, "aos", 16));
+            records.push_back(run<flow::PlanarLayeredField<1>>(map, "planar", 1));
+            records.push_back(run<flow::PlanarLayeredField<4>>(map, "planar", 4));
+            records.push_back(run<flow::PlanarLayeredField<16>>(map, "planar", 16));
+            records.push_back(run<flow::PaddedLayeredField<1>>(map, "padded", 1));
+            records.push_back(run<flow::PaddedLayeredField<4>>(map, "padded", 4));
+            records.push_back(run<flow::TiledLayeredField<1, 8>>(map, "tiled8", 1));
+            records.push_back(run<flow::TiledLayeredField<1, 16>>(map, "tiled16", 1));
+            records.push_back(run<flow::MortonLayeredField<1>>(map, "morton", 1));
+
+            // Every tile resident, then an eighth of them
+            const size_t tiles = ((size_t)size + 63) / 64 * (((size_t)size + 63) / 64);
+            records.push_back(runStreamed(map, tiles));
+            records.push_back(runStreamed(map, std::max<size_t>(2, tiles / 8)));
+        }
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"suite\": \"flow\",\n  \"format\": 1,\n"
+         << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+         << "  \"simd\": \"" << simdLevel() << "\",\n"
+         << "  \"results\": [\n";
+    for (size_t i = 0; i < records.size(); ++i)
+        json << "    " << records[i].str() << (i + 1 < records.size() ? "," : "") << "\n";
+    json << "  ]\n}\n";
+
+    if (outPath.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(outPath);
+        out << json.str();
+        if (!out) {
+            std::cerr << "Cannot write " << outPath << std::endl;
+            return 1;
+        }
+    }
+
+    if (rebuildAllocations != 0) {
+        std::cerr << "Rebuilds made " << rebuildAllocations << " heap allocations, expected none" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
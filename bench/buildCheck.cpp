@@ -0,0 +1,599 @@
+#include "flow.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Compares builds and repairs with a plain breadth first search of the same
+// random map, written here apart from the library. Every check prints its
+// mismatches, and the program exits with 1 if any check has one.
+//
+// Maps are random walls, one-way cells and cells that forbid diagonals, in
+// sizes that are not powers of two.
+//
+// Where two routes are equally short, builds may point along different ones,
+// so routes are compared by their length: the number of steps it takes to
+// follow a layer from a cell to its point of interest. Every step of a route
+// must be a move the map allows.
+//
+// Crowds are stepped on open maps, and must walk as fast along diagonals as
+// along rows and columns. Layers rebuilt in slices for congestion costs must
+// match full weighted builds.
+
+struct Map {
+    uint16_t width;
+    uint16_t height;
+    std::vector<uint8_t> access; // Entry directions in the low nibble, 0x10 if diagonals are allowed
+};
+
+void randomize (Map& map, int wallPercent, std::mt19937& rng) {
+    map.access.resize((size_t)map.width * map.height);
+
+    for (auto& access : map.access) {
+        const int roll = rng() % 100;
+        if (roll < wallPercent)
+            access = 0;
+        else if (roll < wallPercent + 5)
+            access = (1 << (rng() % 4)) | ((rng() % 2) ? 0x10 : 0);
+        else
+            access = 0xF | ((rng() % 3) ? 0x10 : 0);
+    }
+}
+
+template <typename CellType>
+void loadCell (CellType&& cell, uint8_t access) {
+    cell.setEntryDir(access & 0xF);
+    cell.setAllowDiagonal((access & 0x10) != 0);
+}
+
+template <typename FieldType>
+void loadMap (FieldType& field, const Map& map) {
+    for (uint16_t y = 0; y < map.height; ++y)
+        for (uint16_t x = 0; x < map.width; ++x)
+            loadCell(field.at(x, y), map.access[(size_t)y * map.width + x]);
+}
+
+template <typename PointOfInterests = flow::Field::PointOfInterests>
+PointOfInterests randomPoi (const Map& map, size_t count, std::mt19937& rng) {
+    PointOfInterests poi;
+    while (poi.size() < count) {
+        const uint16_t x = rng() % map.width;
+        const uint16_t y = rng() % map.height;
+        if ((map.access[(size_t)y * map.width + x] & 0xF) != 0)
+            poi.push_back({{x, y}});
+    }
+
+    return poi;
+}
+
+const uint32_t unreachable = (uint32_t)(-1);
+const uint32_t unknownLength = unreachable - 1;
+const uint32_t walkedLength = unreachable - 2;
+
+// Index of the cell a move from `cellIdx` leads to, or -1 if the move leaves the map or the map forbids it: diagonal
+// moves need a cell that allows diagonals, and the cell moved into must accept entries in the direction of the move
+long moveTarget (const Map& map, size_t cellIdx, flow::Direction_t dir) {
+    const bool north = dir & 0x1, east = dir & 0x2, south = dir & 0x4, west = dir & 0x8;
+    if (dir == 0 || (north && south) || (east && west) || (map.access[cellIdx] & 0xF) == 0)
+        return -1;
+    if ((north || south) && (east || west) && (map.access[cellIdx] & 0x10) == 0)
+        return -1;
+
+    const long x = (long)(cellIdx % map.width) + (east ? 1 : west ? -1 : 0);
+    const long y = (long)(cellIdx / map.width) + (south ? 1 : north ? -1 : 0);
+    if (x < 0 || y < 0 || x >= map.width || y >= map.height)
+        return -1;
+
+    const long targetIdx = y * map.width + x;
+    return (map.access[targetIdx] & dir) == dir ? targetIdx : -1;
+}
+
+// Steps from every cell to the closest point of interest, in row order. `unreachable` for walls and cells without a route
+template <typename PointOfInterests>
+std::vector<uint32_t> referenceDistances (const Map& map, const PointOfInterests& poi) {
+    std::vector<uint32_t> distance(map.access.size(), unreachable);
+    std::vector<size_t> queue;
+
+    for (const auto& point : poi) {
+        const size_t cellIdx = (size_t)point[1] * map.width + point[0];
+        if (distance[cellIdx] == unreachable) {
+            distance[cellIdx] = 0;
+            queue.push_back(cellIdx);
+        }
+    }
+
+    // Cells around a cell are reached if they can move into it
+    for (size_t i = 0; i < queue.size(); ++i) {
+        const long x = queue[i] % map.width;
+        const long y = queue[i] / map.width;
+
+        for (long dy = -1; dy <= 1; ++dy) {
+            for (long dx = -1; dx <= 1; ++dx) {
+                const long nx = x - dx, ny = y - dy;
+                if ((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= map.width || ny >= map.height)
+                    continue;
+
+                const size_t neighbourIdx = (size_t)ny * map.width + nx;
+                const flow::Direction_t dir = (dy < 0 ? 0x1 : dy > 0 ? 0x4 : 0) | (dx > 0 ? 0x2 : dx < 0 ? 0x8 : 0);
+                if (distance[neighbourIdx] != unreachable || moveTarget(map, neighbourIdx, dir) != (long)queue[i])
+                    continue;
+
+                distance[neighbourIdx] = distance[queue[i]] + 1;
+                queue.push_back(neighbourIdx);
+            }
+        }
+    }
+
+    return distance;
+}
+
+// Steps from every cell to a point of interest along a layer, in row order. A route ends on the first cell of
+// `distance` 0 that points to DEST, and is `unreachable` if it loops, stops or makes a move the map forbids
+template <typename FieldType>
+void routeLengths (FieldType& field, size_t layer, const Map& map, const std::vector<uint32_t>& distance, std::vector<uint32_t>& length) {
+    length.assign(map.access.size(), unknownLength);
+    std::vector<size_t> path;
+
+    for (size_t start = 0; start < length.size(); ++start) {
+        size_t cellIdx = start;
+        path.clear();
+
+        // Walk until a cell whose length is known
+        while (length[cellIdx] == unknownLength) {
+            const auto dir = field.getDirection(layer, cellIdx % map.width, cellIdx / map.width);
+            if (dir == flow::Directions::DEST && distance[cellIdx] == 0) {
+                length[cellIdx] = 0;
+                break;
+            }
+
+            const long nextIdx = moveTarget(map, cellIdx, dir);
+            if (nextIdx < 0) {
+                length[cellIdx] = unreachable;
+                break;
+            }
+
+            length[cellIdx] = walkedLength;
+            path.push_back(cellIdx);
+            cellIdx = nextIdx;
+        }
+
+        const bool routed = length[cellIdx] != walkedLength && length[cellIdx] != unreachable;
+        uint32_t steps = routed ? length[cellIdx] : unreachable;
+        for (auto i = path.size(); i-- > 0; ) {
+            if (routed)
+                ++steps;
+            length[path[i]] = steps;
+        }
+    }
+}
+
+// Mismatches between the routes of a layer and reference distances. Every reachable cell must have a route, exactly as
+// long as its distance if `exact`. The longest detour of a route is kept in `worstDetour` if it is not null
+template <typename FieldType>
+size_t compareRoutes (const char * name, FieldType& field, size_t layer, const Map& map, const std::vector<uint32_t>& distance, bool exact, size_t * worstDetour = nullptr) {
+    std::vector<uint32_t> length;
+    routeLengths(field, layer, map, distance, length);
+
+    size_t mismatch = 0;
+    for (size_t cellIdx = 0; cellIdx < length.size(); ++cellIdx) {
+        if (distance[cellIdx] == unreachable)
+            continue;
+
+        const bool routed = length[cellIdx] != unreachable;
+        if (routed && worstDetour != nullptr)
+            *worstDetour = std::max<size_t>(*worstDetour, length[cellIdx] - distance[cellIdx]);
+        if (routed && (!exact || length[cellIdx] == distance[cellIdx]))
+            continue;
+
+        if (mismatch < 5)
+            std::cout << "  " << name << " layer " << layer << " cell (" << cellIdx % map.width << "," << cellIdx / map.width
+                      << ") distance " << distance[cellIdx] << " route " << (int64_t)(int32_t)length[cellIdx] << std::endl;
+        ++mismatch;
+    }
+
+    return mismatch;
+}
+
+// Opens or closes `count` random cells, points of interest excepted
+std::vector<flow::Field::Vec2> toggleCells (Map& map, const flow::Field::PointOfInterests& poi, size_t count, bool open, std::mt19937& rng) {
+    std::vector<flow::Field::Vec2> changed;
+    while (changed.size() < count) {
+        const uint16_t x = rng() % map.width;
+        const uint16_t y = rng() % map.height;
+        auto& access = map.access[(size_t)y * map.width + x];
+        if (((access & 0xF) != 0) == open || std::find(poi.begin(), poi.end(), flow::Field::Vec2{{x, y}}) != poi.end())
+            continue;
+
+        access = open ? 0xF | 0x10 : 0;
+        changed.push_back({{x, y}});
+    }
+
+    return changed;
+}
+
+/// Compares some builds on a map, and returns their number of mismatched cells
+typedef size_t (*Check)(const char * name, const Map& map, std::mt19937& rng);
+
+// Runs a check on a random map and prints its mismatches
+size_t runCheck (const char * name, Check check, uint16_t width, uint16_t height, int wallPercent, unsigned seed) {
+    std::mt19937 rng(seed);
+    Map map = {width, height, {}};
+    randomize(map, wallPercent, rng);
+
+    const size_t mismatch = check(name, map, rng);
+    std::cout << name << "  map " << width << "x" << height << "  walls " << wallPercent
+              << "%  seed " << seed << "  mismatched cells " << mismatch << std::endl;
+
+    return mismatch;
+}
+
+// Mismatches between the distances a layer keeps and reference distances
+template <typename FieldType>
+size_t compareDistances (const char * name, FieldType& field, size_t layer, const Map& map, const std::vector<uint32_t>& distance) {
+    size_t mismatch = 0;
+    for (size_t cellIdx = 0; cellIdx < distance.size(); ++cellIdx) {
+        const uint32_t kept = field.getDistance(layer, cellIdx % map.width, cellIdx / map.width);
+        if (kept == distance[cellIdx])
+            continue;
+
+        if (mismatch < 5)
+            std::cout << "  " << name << " layer " << layer << " cell (" << cellIdx % map.width << "," << cellIdx / map.width
+                      << ") distance " << (int64_t)(int32_t)distance[cellIdx] << " kept " << (int64_t)(int32_t)kept << std::endl;
+        ++mismatch;
+    }
+
+    return mismatch;
+}
+
+// Repairs two layers round after round, closing cells then opening cells. Routes must stay exactly as long as the
+// distances of the map. The second layer keeps its distances, which must match them too
+size_t checkRepair (const char * name, const Map& originalMap, std::mt19937& rng) {
+    Map map = originalMap;
+    flow::Field::PointOfInterests poi[2] = {randomPoi(map, 1, rng), randomPoi(map, 3, rng)};
+
+    flow::LayeredField<2> field(map.width, map.height);
+    loadMap(field, map);
+    field.keepDistances(1);
+    field.addPointOfInterest(0, poi[0]);
+    field.addPointOfInterest(1, poi[1]);
+
+    // Points of interest of both layers stay open
+    flow::Field::PointOfInterests allPoi = poi[0];
+    allPoi.insert(allPoi.end(), poi[1].begin(), poi[1].end());
+
+    size_t mismatch = 0;
+    for (int round = 0; round < 6; ++round) {
+        const bool open = round % 2 == 1;
+        const auto changed = toggleCells(map, allPoi, 24, open, rng);
+
+        loadMap(field, map);
+        field.updateCells(changed);
+
+        for (size_t layer = 0; layer < 2; ++layer) {
+            const auto distance = referenceDistances(map, poi[layer]);
+            mismatch += compareRoutes(open ? "after opening" : "after closing", field, layer, map, distance, true);
+            if (layer == 1)
+                mismatch += compareDistances(open ? "after opening" : "after closing", field, layer, map, distance);
+        }
+    }
+
+    return mismatch;
+}
+
+// Repairs a weighted layer round after round, closing cells then opening cells. Its kept distances must match a full
+// weighted build of the same map
+size_t checkWeightedRepair (const char * name, const Map& originalMap, std::mt19937& rng) {
+    Map map = originalMap;
+    const auto poi = randomPoi(map, 2, rng);
+
+    flow::Field field(map.width, map.height);
+    loadMap(field, map);
+    field.keepDistances(0);
+    field.addPointOfInterest(0, poi, flow::BuildModes::WEIGHTED);
+
+    size_t mismatch = 0;
+    for (int round = 0; round < 6; ++round) {
+        const bool open = round % 2 == 1;
+        const auto changed = toggleCells(map, poi, 24, open, rng);
+        loadMap(field, map);
+        field.updateCells(changed);
+
+        flow::Field rebuilt(map.width, map.height);
+        loadMap(rebuilt, map);
+        rebuilt.keepDistances(0);
+        rebuilt.addPointOfInterest(0, poi, flow::BuildModes::WEIGHTED);
+
+        std::vector<uint32_t> distance(map.access.size());
+        for (size_t cellIdx = 0; cellIdx < distance.size(); ++cellIdx)
+            distance[cellIdx] = rebuilt.getDistance(0, cellIdx % map.width, cellIdx / map.width);
+
+        mismatch += compareDistances(open ? "after opening" : "after closing", field, 0, map, distance);
+    }
+
+    return mismatch;
+}
+
+// A build and a repair after closing cells in another cell layout. Routes and kept distances must match the map
+template <typename FieldType>
+size_t checkLayout (const char * name, const Map& originalMap, std::mt19937& rng) {
+    Map map = originalMap;
+    FieldType field(map.width, map.height);
+    loadMap(field, map);
+    field.keepDistances(0);
+
+    const auto poi = randomPoi(map, 2, rng);
+    field.addPointOfInterest(0, poi);
+
+    const auto distance = referenceDistances(map, poi);
+    size_t mismatch = compareDistances(name, field, 0, map, distance);
+    mismatch += compareRoutes(name, field, 0, map, distance, true);
+
+    const auto changed = toggleCells(map, poi, 20, false, rng);
+    loadMap(field, map);
+    field.updateCells(changed);
+    mismatch += compareRoutes("repair", field, 0, map, referenceDistances(map, poi), true);
+
+    return mismatch;
+}
+
+// Builds all layers in one traversal, after builds of other goals so stale build IDs are around. Every layer must be as long as a separate build
+template <typename FieldType, size_t LayerCount>
+size_t checkMultiLayer (const char * name, const Map& map, std::mt19937& rng) {
+    FieldType field(map.width, map.height);
+    loadMap(field, map);
+
+    typename FieldType::LayerPointOfInterests layerPoi;
+    for (size_t layer = 0; layer < LayerCount; ++layer) {
+        field.addPointOfInterest(layer, randomPoi(map, 1, rng));
+        layerPoi.push_back(std::make_pair(layer, randomPoi(map, 1 + layer % 3, rng)));
+    }
+
+    field.addPointOfInterest(layerPoi);
+
+    size_t mismatch = 0;
+    for (const auto& entry : layerPoi)
+        mismatch += compareRoutes(name, field, entry.first, map, referenceDistances(map, entry.second), true);
+
+    return mismatch;
+}
+
+// Bitboard builds, more than 15 of them so build IDs wrap, then a repair after closing cells. Routes and kept distances must match the map
+template <typename FieldType>
+size_t checkBitboard (const char * name, const Map& originalMap, std::mt19937& rng) {
+    Map map = originalMap;
+    FieldType field(map.width, map.height);
+    loadMap(field, map);
+    field.keepDistances(0);
+
+    size_t mismatch = 0;
+    flow::Field::PointOfInterests poi;
+    for (int round = 0; round < 18; ++round) {
+        poi = randomPoi(map, 1 + round % 3, rng);
+        field.addPointOfInterest(0, poi, flow::BuildModes::BITBOARD);
+
+        // Routes are walked every few rounds only, they take most of the time
+        const auto distance = referenceDistances(map, poi);
+        mismatch += compareDistances(name, field, 0, map, distance);
+        if (round % 6 == 5)
+            mismatch += compareRoutes(name, field, 0, map, distance, true);
+    }
+
+    const auto changed = toggleCells(map, poi, 20, false, rng);
+    loadMap(field, map);
+    field.updateCells(changed);
+    mismatch += compareRoutes("repair", field, 0, map, referenceDistances(map, poi), true);
+
+    return mismatch;
+}
+
+// Eikonal builds of changing goals. Their routes are not the shortest in steps, but they must only make moves the map
+// allows, and reach a point of interest from every reachable cell
+template <typename FieldType>
+size_t checkEikonal (const char * name, const Map& map, std::mt19937& rng) {
+    FieldType field(map.width, map.height);
+    loadMap(field, map);
+
+    size_t mismatch = 0;
+    for (int round = 0; round < 6; ++round) {
+        const auto poi = randomPoi(map, 1 + round % 3, rng);
+        field.addPointOfInterest(0, poi, flow::BuildModes::EIKONAL);
+        mismatch += compareRoutes(name, field, 0, map, referenceDistances(map, poi), false);
+    }
+
+    return mismatch;
+}
+
+// Builds of a field in a scratch file with 4 tiles in memory, more than 15 of them so build IDs wrap. Routes must match the map
+size_t checkStreamed (const char * name, const Map& map, std::mt19937& rng) {
+    flow::StreamedLayeredField<1, 8> field(map.width, map.height, "check.tiles", 4);
+    loadMap(field, map);
+
+    size_t mismatch = 0;
+    for (int round = 0; round < 20; ++round) {
+        const auto poi = randomPoi<flow::StreamedField::PointOfInterests>(map, 1 + round % 3, rng);
+        field.addPointOfInterest(0, poi);
+
+        // Routes are walked every few rounds only, they take most of the time
+        if (round % 5 == 4)
+            mismatch += compareRoutes(name, field, 0, map, referenceDistances(map, poi), true);
+    }
+
+    return mismatch;
+}
+
+// Sector fields before and after walls open and close, in the sector corners too. Routes may be longer than the distances
+// of the map, but must reach the same cells
+template <size_t SectorSize>
+size_t checkSectorField (const char * name, const Map& originalMap, std::mt19937& rng) {
+    Map map = originalMap;
+    const auto poi = randomPoi(map, 1 + rng() % 3, rng);
+
+    flow::LayeredSectorField<1, SectorSize> sectors(map.width, map.height);
+    loadMap(sectors, map);
+    sectors.addPointOfInterest(0, poi);
+
+    size_t worstDetour = 0;
+    size_t mismatch = compareRoutes(name, sectors, 0, map, referenceDistances(map, poi), false, &worstDetour);
+
+    std::vector<flow::Field::Vec2> changed;
+    for (int i = 0; i < 40; ++i) {
+        const uint16_t x = (i % 2 ? rng() % (map.width / SectorSize + 1) * SectorSize : rng()) % map.width;
+        const uint16_t y = rng() % map.height;
+        auto& access = map.access[(size_t)y * map.width + x];
+        access = access ? 0 : 0xF | 0x10;
+        changed.push_back({{x, y}});
+    }
+
+    // Points of interest stay open
+    for (auto point : poi) {
+        map.access[(size_t)point[1] * map.width + point[0]] = 0xF;
+        changed.push_back(point);
+    }
+
+    loadMap(sectors, map);
+    sectors.updateCells(changed);
+    mismatch += compareRoutes("update", sectors, 0, map, referenceDistances(map, poi), false, &worstDetour);
+
+    std::cout << "  " << name << " worst detour " << worstDetour << std::endl;
+
+    return mismatch;
+}
+
+// Crowds on an open map of the same size, with agents as far from a point of interest in each of the 8 directions. Agents
+// walk `speed` cells per step in every direction, so they must arrive within a step of the time their straight line takes
+template <bool Smooth>
+size_t checkCrowd (const char * name, const Map& map, std::mt19937& rng) {
+    flow::Field field(map.width, map.height);
+    for (auto cell = field.begin(); cell != field.end(); ++cell) {
+        cell->setEntryDir(0xF);
+        cell->setAllowDiagonal(true);
+    }
+
+    const uint16_t goalX = map.width / 2, goalY = map.height / 2;
+    const int reach = std::min(map.width, map.height) / 2 - 1;
+    field.addPointOfInterest(0, {{{goalX, goalY}}});
+
+    std::vector<float> x, y, speed, expected;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            if (dx == 0 && dy == 0)
+                continue;
+
+            x.push_back(goalX + dx * reach + 0.5f);
+            y.push_back(goalY + dy * reach + 0.5f);
+            speed.push_back(0.25f + (rng() % 76) / 100.0f);
+
+            // The goal cell starts half a cell before its center, measured along the route
+            expected.push_back((reach - 0.5f) * (dx != 0 && dy != 0 ? 1.41421356f : 1.0f) / speed.back());
+        }
+    }
+
+    flow::CrowdStepper<flow::Field> crowd(field);
+    crowd.smoothSteering(Smooth);
+
+    std::vector<size_t> arrived;
+    std::vector<int> arrival(x.size(), -1);
+    for (int steps = 1; steps <= 8 * reach; ++steps) {
+        crowd.step(0, x.size(), x.data(), y.data(), speed.data(), arrived);
+        for (auto agent : arrived)
+            if (arrival[agent] < 0)
+                arrival[agent] = steps;
+    }
+
+    size_t mismatch = 0;
+    for (size_t agent = 0; agent < x.size(); ++agent) {
+        if (arrival[agent] >= 0 && std::abs(arrival[agent] - expected[agent]) <= 1.0f)
+            continue;
+
+        std::cout << "  " << name << " agent " << agent << " speed " << speed[agent] << " expected after "
+                  << expected[agent] << " steps, arrived after " << arrival[agent] << std::endl;
+        ++mismatch;
+    }
+
+    return mismatch;
+}
+
+// A crowd on the map, and a layer rebuilt with its congestion costs in slices behind a back layer, round after round.
+// Each published layer must keep the distances of a full weighted build with the same costs
+size_t checkCongestion (const char * name, const Map& map, std::mt19937& rng) {
+    const auto poi = randomPoi(map, 2, rng);
+
+    flow::LayeredField<3> field(map.width, map.height);
+    loadMap(field, map);
+    std::vector<uint8_t> costs(map.access.size());
+    for (auto& cost : costs)
+        cost = 1 + rng() % 4;
+    field.loadCosts(costs.data());
+    for (size_t layer = 0; layer < 3; ++layer)
+        field.keepDistances(layer);
+
+    flow::CongestionField<flow::LayeredField<3>> congestion(field, 4);
+    congestion.track(0, 1, poi);
+
+    std::vector<float> x(map.access.size() / 4), y(x.size());
+    size_t mismatch = 0;
+    for (int round = 0; round < 3; ++round) {
+        for (size_t agent = 0; agent < x.size(); ++agent) {
+            x[agent] = (rng() % map.width) + 0.5f;
+            y[agent] = (rng() % map.height) + 0.5f;
+        }
+
+        // The crowd stands still, so the costs only change in the first update of the round
+        const size_t front = congestion.front(0);
+        size_t updates = 0;
+        do {
+            congestion.clear();
+            congestion.splat(x.size(), x.data(), y.data());
+            ++updates;
+        } while (congestion.update(0, 97) == 0 && updates < map.access.size());
+
+        if (congestion.front(0) == front) {
+            std::cout << "  " << name << " round " << round << " was not published after " << updates << " updates" << std::endl;
+            ++mismatch;
+        }
+
+        field.addPointOfInterest(2, poi, flow::BuildModes::WEIGHTED);
+        std::vector<uint32_t> distance(map.access.size());
+        for (size_t cellIdx = 0; cellIdx < distance.size(); ++cellIdx)
+            distance[cellIdx] = field.getDistance(2, cellIdx % map.width, cellIdx / map.width);
+
+        mismatch += compareDistances("published", field, congestion.front(0), map, distance);
+    }
+
+    return mismatch;
+}
+
+int main (int argc, char ** argv) {
+    const unsigned seeds = argc > 1 ? (unsigned)std::atoi(argv[1]) : 10;
+    size_t mismatch = 0;
+
+    for (unsigned seed = 0; seed < seeds; ++seed) {
+        mismatch += runCheck("repair", checkRepair, 96, 71, 20, seed);
+        mismatch += runCheck("weighted repair", checkWeightedRepair, 87, 66, 20, seed);
+        mismatch += runCheck("tiled 8", checkLayout<flow::TiledLayeredField<1, 8>>, 75, 98, 20, seed);
+        mismatch += runCheck("tiled 16", checkLayout<flow::TiledLayeredField<1, 16>>, 75, 98, 20, seed);
+        mismatch += runCheck("morton", checkLayout<flow::MortonLayeredField<1>>, 75, 98, 20, seed);
+        mismatch += runCheck("padded", checkLayout<flow::PaddedField>, 75, 98, 20, seed);
+        mismatch += runCheck("multi-layer", checkMultiLayer<flow::LayeredField<5>, 5>, 83, 77, 20, seed);
+        mismatch += runCheck("multi-layer planar", checkMultiLayer<flow::PlanarLayeredField<12>, 12>, 83, 77, 20, seed);
+        mismatch += runCheck("bitboard", checkBitboard<flow::Field>, 101, 67, 15, seed);
+        mismatch += runCheck("bitboard planar", checkBitboard<flow::PlanarField>, 101, 67, 15, seed);
+        mismatch += runCheck("eikonal", checkEikonal<flow::Field>, 89, 74, 20, seed);
+        mismatch += runCheck("streamed", checkStreamed, 70, 53, 20, seed);
+        mismatch += runCheck("sectors 16", checkSectorField<16>, 112, 62, 25, seed);
+        mismatch += runCheck("sectors 8", checkSectorField<8>, 61, 45, 35, seed);
+        mismatch += runCheck("crowd", checkCrowd<false>, 57, 49, 0, seed);
+        mismatch += runCheck("crowd smooth", checkCrowd<true>, 57, 49, 0, seed);
+        mismatch += runCheck("congestion", checkCongestion, 93, 58, 20, seed);
+    }
+
+    if (mismatch != 0) {
+        std::cout << "FAILED: " << mismatch << " mismatches" << std::endl;
+        return 1;
+    }
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "flow.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Builds every layer of several fields concurrently, round after round, while
+// walls move between rounds. Each layer is compared with a fresh field built
+// serially from the same map. Cells the reference does not reach are skipped:
+// a build leaves them as they were.
+//
+// The map has a walled vault whose door only opens every 15 rounds, so its
+// cells keep the build ID of the previous opening until the IDs wrap. A stale
+// cell matching the current build would be skipped and show up as a mismatch.
+
+const size_t layerCount = 4;
+const size_t fieldCount = 3;
+
+using StressField = flow::LayeredField<layerCount>;
+using StressPlanarField = flow::PlanarLayeredField<layerCount>;
+
+struct Map {
+    std::vector<uint8_t> access;
+    std::vector<StressField::PointOfInterests> poi; // One per layer
+};
+
+template <typename FieldType>
+void loadMap (FieldType& field, const Map& map) {
+    for (auto cell = field.begin(); cell != field.end(); ++cell) {
+        cell->setEntryDir(map.access[cell.idx] & 0xF);
+        cell->setAllowDiagonal((map.access[cell.idx] & 0x10) != 0);
+    }
+}
+
+void randomize (Map& map, uint16_t size, int round, std::mt19937& rng) {
+    for (auto& access : map.access) {
+        const int roll = rng() % 100;
+        if (roll < 5)
+            access = 0;
+        else if (roll < 30)
+            access = 0xF | 0x10;
+        else
+            access = 0xF;
+    }
+
+    const size_t low = size / 4, high = size * 3 / 4;
+    for (size_t i = low; i <= high; ++i) {
+        map.access[low * size + i] = 0;
+        map.access[high * size + i] = 0;
+        map.access[i * size + low] = 0;
+        map.access[i * size + high] = 0;
+    }
+
+    if (round % 15 == 0)
+        map.access[low * size + size / 2] = 0xF;
+
+    for (auto& poi : map.poi) {
+        poi.clear();
+        const size_t count = 1 + rng() % 3;
+        while (poi.size() < count) {
+            const uint16_t x = rng() % size, y = rng() % size;
+            if (x < low || x > high || y < low || y > high) // Outside the vault
+                poi.push_back({x, y});
+        }
+    }
+}
+
+template <typename FieldType>
+size_t countMismatches (FieldType& field, size_t layer, uint16_t size, const Map& map) {
+    StressField reference(size, size);
+    loadMap(reference, map);
+    reference.addPointOfInterest(layer, map.poi[layer], layer % 2 ? flow::BuildModes::WEIGHTED : flow::BuildModes::BREADTH_FIRST);
+
+    size_t mismatch = 0;
+    for (uint16_t y = 0; y < size; ++y) {
+        for (uint16_t x = 0; x < size; ++x) {
+            const auto expected = reference.getDirection(layer, x, y);
+            mismatch += expected != flow::Directions::STOP && field.getDirection(layer, x, y) != expected;
+        }
+    }
+
+    return mismatch;
+}
+
+int main (int argc, char ** argv) {
+    const uint16_t size = argc > 1 ? (uint16_t)std::atoi(argv[1]) : 96;
+    const int rounds = argc > 2 ? std::atoi(argv[2]) : 64;
+
+    std::mt19937 rng(42);
+    Map map;
+    map.access.assign((size_t)size * size, 0xF);
+    map.poi.resize(layerCount);
+
+    std::vector<std::unique_ptr<StressField>> fields;
+    for (size_t i = 0; i < fieldCount; ++i)
+        fields.emplace_back(new StressField(size, size));
+    StressPlanarField planar(size, size);
+
+    size_t mismatch = 0;
+    for (int round = 0; round < rounds; ++round) {
+        randomize(map, size, round, rng);
+        for (auto& field : fields)
+            loadMap(*field, map);
+        loadMap(planar, map);
+
+        // One thread per (field, layer), all running at the same time
+        std::vector<std::thread> threads;
+        for (size_t f = 0; f <= fieldCount; ++f) {
+            for (size_t layer = 0; layer < layerCount; ++layer) {
+                threads.emplace_back([&, f, layer] {
+                    const auto mode = layer % 2 ? flow::BuildModes::WEIGHTED : flow::BuildModes::BREADTH_FIRST;
+                    if (f < fieldCount)
+                        fields[f]->addPointOfInterest(layer, map.poi[layer], mode);
+                    else
+                        planar.addPointOfInterest(layer, map.poi[layer], mode);
+                });
+            }
+        }
+
+        for (auto& thread : threads)
+            thread.join();
+
+        for (size_t layer = 0; layer < layerCount; ++layer) {
+            for (auto& field : fields)
+                mismatch += countMismatches(*field, layer, size, map);
+            mismatch += countMismatches(planar, layer, size, map);
+        }
+    }
+
+    std::cout << rounds << " rounds, " << (fieldCount + 1) * layerCount << " concurrent builds per round, "
+              << "mismatched cells " << mismatch << std::endl;
+
+    return mismatch == 0 ? 0 : 1;
+}
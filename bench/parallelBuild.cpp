@@ -0,0 +1,135 @@
+#include "flow.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// Open map with a regular grid of pillars and a one-way lane every 64 columns.
+// Every non-wall cell is reachable, so both builds write every cell
+template <typename FieldType>
+void fillMap (FieldType& field, uint16_t size) {
+    for (auto cell = field.begin(); cell != field.end(); ++cell) {
+        const size_t x = cell.idx % size;
+        const size_t y = cell.idx / size;
+
+        cell->setAllowDiagonal(true);
+        if (x % 4 == 2 && y % 4 == 2) {
+            cell->setEntryDir(0);
+            cell->setAllowDiagonal(false);
+        } else if (x % 64 == 63 && y > 0 && y < size - 1u) {
+            cell->setEntryDir(flow::Directions::NORTH);
+        } else {
+            cell->setEntryDir(flow::Directions::NORTH |
+                    flow::Directions::EAST |
+                    flow::Directions::SOUTH |
+                    flow::Directions::WEST);
+        }
+    }
+}
+
+template <typename Fn>
+double measureMs (Fn fn, int repeat) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i)
+        fn();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repeat;
+}
+
+int main (int argc, char ** argv) {
+    const uint16_t size = argc > 1 ? (uint16_t)std::atoi(argv[1]) : 1024;
+    const size_t maxThreads = argc > 2 ? (size_t)std::atoi(argv[2]) : std::thread::hardware_concurrency();
+    const int repeat = 3;
+
+    flow::Field reference(size, size);
+    flow::Field field(size, size);
+    fillMap(reference, size);
+    fillMap(field, size);
+
+    flow::Field::PointOfInterests poi = {
+        {(uint16_t)(size / 2), (uint16_t)(size / 2)},
+        {0, 0},
+    };
+
+    const double serialMs = measureMs([&] { reference.addPointOfInterest(0, poi); }, repeat);
+    std::cout << "map " << size << "x" << size << std::endl;
+    std::cout << "serial     " << serialMs << " ms" << std::endl;
+
+    for (size_t threads = 1; threads <= std::max<size_t>(maxThreads, 1); ++threads) {
+        flow::ThreadPool pool(threads);
+        const double parallelMs = measureMs([&] { field.addPointOfInterest(0, poi, pool); }, repeat);
+
+        size_t mismatch = 0;
+        for (uint16_t y = 0; y < size; ++y)
+            for (uint16_t x = 0; x < size; ++x)
+                mismatch += reference.getDirection(0, x, y) != field.getDirection(0, x, y);
+
+        std::cout << "threads " << threads << "  " << parallelMs << " ms"
+                  << "  speedup " << serialMs / parallelMs
+                  << "  mismatched cells " << mismatch << std::endl;
+
+        if (mismatch != 0)
+            return 1;
+    }
+
+    // A batch of layer builds over several map shards, one by one and through the scheduler
+    using ShardField = flow::LayeredField<4>;
+    const size_t shardCount = 4;
+    const uint16_t shardSize = std::max<uint16_t>(size / 2, 8);
+
+    std::vector<std::unique_ptr<ShardField>> shards;
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards.emplace_back(new ShardField(shardSize, shardSize));
+        fillMap(*shards.back(), shardSize);
+    }
+
+    auto shardPoi = [&](size_t shard, size_t layer) {
+        return ShardField::PointOfInterests{{(uint16_t)((shard * 7 + layer * 13) % shardSize), (uint16_t)(layer * shardSize / 4)}};
+    };
+
+    ShardField shardReference(shardSize, shardSize);
+    fillMap(shardReference, shardSize);
+
+    const double batchSerialMs = measureMs([&] {
+        for (size_t shard = 0; shard < shardCount; ++shard)
+            for (size_t layer = 0; layer < shardReference.layerCount(); ++layer)
+                shards[shard]->addPointOfInterest(layer, shardPoi(shard, layer));
+    }, repeat);
+
+    std::cout << "batch of " << shardCount * shardReference.layerCount() << " builds, " << shardSize << "x" << shardSize << std::endl;
+    std::cout << "serial     " << batchSerialMs << " ms" << std::endl;
+
+    for (size_t threads = 1; threads <= std::max<size_t>(maxThreads, 1); ++threads) {
+        flow::ThreadPool pool(threads);
+        flow::BuildScheduler scheduler(pool);
+
+        const double scheduledMs = measureMs([&] {
+            for (size_t shard = 0; shard < shardCount; ++shard)
+                for (size_t layer = 0; layer < shardReference.layerCount(); ++layer)
+                    scheduler.submit(*shards[shard], layer, shardPoi(shard, layer), (int)layer);
+            scheduler.run();
+        }, repeat);
+
+        size_t mismatch = 0;
+        for (size_t shard = 0; shard < shardCount; ++shard) {
+            for (size_t layer = 0; layer < shardReference.layerCount(); ++layer) {
+                shardReference.addPointOfInterest(layer, shardPoi(shard, layer));
+
+                for (uint16_t y = 0; y < shardSize; ++y)
+                    for (uint16_t x = 0; x < shardSize; ++x)
+                        mismatch += shardReference.getDirection(layer, x, y) != shards[shard]->getDirection(layer, x, y);
+            }
+        }
+
+        std::cout << "threads " << threads << "  " << scheduledMs << " ms"
+                  << "  speedup " << batchSerialMs / scheduledMs
+                  << "  mismatched cells " << mismatch << std::endl;
+
+        if (mismatch != 0)
+            return 1;
+    }
+
+    return 0;
+}
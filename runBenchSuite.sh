@@ -0,0 +1,4 @@
+#! /bin/bash
+
+# Extra compiler flags can be passed through CXXFLAGS, e.g. CXXFLAGS=-mavx2 ./runBenchSuite.sh --sizes 1024
+g++ -std=c++11 -O2 -DNDEBUG $CXXFLAGS -pthread -I./src ./bench/benchSuite.cpp -o benchSuite.out; if [ $? -eq 0 ]; then ./benchSuite.out "$@"; fi
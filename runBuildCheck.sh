@@ -0,0 +1,3 @@
+#! /bin/bash
+
+g++ -std=c++11 -O2 -DNDEBUG -pthread -I./src ./bench/buildCheck.cpp -o check.out; if [ $? -eq 0 ]; then ./check.out "$@"; fi
@@ -1,4 +1,4 @@
 #! /bin/bash
 
-g++ -std=c++11 ./src/*.cpp; if [ $? -eq 0 ]; then ./a.out; fi
+g++ -std=c++11 -pthread ./src/*.cpp; if [ $? -eq 0 ]; then ./a.out; fi
 
@@ -0,0 +1,3 @@
+#! /bin/bash
+
+g++ -std=c++11 -O2 -DNDEBUG -pthread -I./src ./bench/buildStress.cpp -o stress.out; if [ $? -eq 0 ]; then ./stress.out "$@"; fi
@@ -0,0 +1,132 @@
+#include "asyncLayer.hpp"
+
+#ifndef async_layer_cpp
+#define async_layer_cpp
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace flow {
+
+template <typename F>
+AsyncLayer<F>::AsyncLayer (F& _field, size_t frontLayer, size_t backLayer) :
+    field(_field),
+    bufferLayers{frontLayer, backLayer},
+    front(0),
+    pending(),
+    slicing(false),
+    sliced(false)
+{
+    if (frontLayer >= _field.layerCount() || backLayer >= _field.layerCount() || frontLayer == backLayer)
+        throw std::range_error("Layer out of range");
+
+    readers[0].store(0, std::memory_order_relaxed);
+    readers[1].store(0, std::memory_order_relaxed);
+}
+
+template <typename F>
+AsyncLayer<F>::~AsyncLayer () {
+    if (pending.valid())
+        pending.wait();
+}
+
+template <typename F>
+std::shared_future<void> AsyncLayer<F>::build (const PointOfInterests& poi, BuildModes::BuildMode_t mode) {
+    if (pending.valid() && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        throw std::logic_error("A build is already running");
+
+    const uint8_t back = 1 - front.load(std::memory_order_relaxed);
+    slicing = sliced = false;
+
+    pending = std::async(std::launch::async, [this, poi, mode, back] {
+        waitForReaders(back);
+        field.addPointOfInterest(bufferLayers[back], poi, mode);
+    }).share();
+
+    return pending;
+}
+
+template <typename F>
+void AsyncLayer<F>::beginBuild (const PointOfInterests& poi) {
+    if (pending.valid() && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        throw std::logic_error("A build is already running");
+
+    const uint8_t back = 1 - front.load(std::memory_order_relaxed);
+    pending = std::shared_future<void>();
+    slicing = sliced = false;
+
+    waitForReaders(back);
+    field.beginBuild(bufferLayers[back], poi, workspace);
+    slicing = true;
+}
+
+template <typename F>
+bool AsyncLayer<F>::continueBuild (size_t maxCells) {
+    if (!slicing)
+        return sliced;
+
+    const uint8_t back = 1 - front.load(std::memory_order_relaxed);
+    if (field.continueBuild(bufferLayers[back], maxCells, workspace)) {
+        slicing = false;
+        sliced = true;
+    }
+
+    return sliced;
+}
+
+template <typename F>
+bool AsyncLayer<F>::ready () const {
+    return sliced || (pending.valid() && pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+}
+
+template <typename F>
+bool AsyncLayer<F>::publish () {
+    if (!ready())
+        return false;
+
+    // Consume the build first, so a failed build is reported instead of published
+    if (sliced) {
+        sliced = false;
+    } else {
+        std::shared_future<void> finished = std::move(pending);
+        finished.get();
+    }
+
+    // Readers that see the new front also see every direction written by the build
+    front.store(1 - front.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+    return true;
+}
+
+/* Pinning.
+ *
+ * A reader registers on the buffer it saw, then checks that the buffer is
+ * still the front. If a publish happened in between, the buffer may already
+ * be handed to a build, so the reader moves to the new front instead. The
+ * build checks for readers after the publish, so a reader that passed the
+ * check is always seen (all operations are sequentially consistent).
+ */
+template <typename F>
+typename AsyncLayer<F>::Reader AsyncLayer<F>::read () {
+    while (true) {
+        const uint8_t buffer = front.load(std::memory_order_seq_cst);
+        readers[buffer].fetch_add(1, std::memory_order_seq_cst);
+
+        if (front.load(std::memory_order_seq_cst) == buffer)
+            return Reader(this, buffer);
+
+        readers[buffer].fetch_sub(1, std::memory_order_release);
+    }
+}
+
+/// Called by the build before it writes `buffer`. Readers of the previous front finish their queries
+template <typename F>
+void AsyncLayer<F>::waitForReaders (uint8_t buffer) const {
+    while (readers[buffer].load(std::memory_order_seq_cst) != 0)
+        std::this_thread::yield();
+}
+
+} // namespace flow
+
+#endif // async_layer_cpp
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <atomic>
+#include <future>
+
+#include "buildModes.hpp"
+#include "field.hpp"
+
+namespace flow {
+    /* Double-buffered layer, rebuilt in the background.
+     *
+     * Two layers of a field act as the front and back buffer of one logical
+     * layer. Readers query the front layer while build() fills the back layer
+     * on a worker thread. publish() swaps the buffers with a single atomic
+     * store, at a point of the caller's choosing (e.g. the frame boundary), so
+     * readers either see the complete old field or the complete new one.
+     *
+     * Readers pin the layer they query with read(). Pinning never blocks; a
+     * build only starts writing the back layer once every reader that still
+     * holds it (from before the latest publish) is done.
+     *
+     * A WEIGHTED build can also be carried out on the calling thread in slices
+ * (beginBuild and continueBuild), e.g. one slice per frame, so that no frame
+ * pays for the whole build.
+ *
+ * build(), beginBuild(), continueBuild() and publish() are called from one thread. The access data of the
+     * field must not change while a build runs, and updateCells must not be
+     * called until the build was published (it repairs every built layer).
+     */
+    template <typename FieldType>
+    class AsyncLayer {
+    public:
+        using PointOfInterests = typename FieldType::PointOfInterests;
+
+        /// Pins the front layer for the lifetime of the reader
+        class Reader {
+            friend class AsyncLayer;
+
+        public:
+            Reader (Reader&& other) :
+                owner(other.owner),
+                buffer(other.buffer)
+            {
+                other.owner = nullptr;
+            }
+
+            ~Reader () {
+                if (owner != nullptr)
+                    owner->readers[buffer].fetch_sub(1, std::memory_order_release);
+            }
+
+            Reader (const Reader&) = delete;
+            Reader& operator= (const Reader&) = delete;
+
+            /// Layer of the field to query
+            size_t layer () const {
+                return owner->bufferLayers[buffer];
+            }
+
+        private:
+            AsyncLayer * owner;
+            uint8_t buffer;
+
+        private:
+            Reader (AsyncLayer * _owner, uint8_t _buffer) :
+                owner(_owner),
+                buffer(_buffer)
+            {}
+        };
+
+    public:
+        /// Use `frontLayer` and `backLayer` of `_field` as the two buffers. The front layer is what readers see until the first publish
+        AsyncLayer (FieldType& _field, size_t frontLayer, size_t backLayer);
+
+        /// Waits for a running build
+        ~AsyncLayer ();
+
+        AsyncLayer (const AsyncLayer&) = delete;
+        AsyncLayer& operator= (const AsyncLayer&) = delete;
+
+        /// Start building `poi` into the back layer on a worker thread. A finished but unpublished build is discarded
+        std::shared_future<void> build (const PointOfInterests& poi, BuildModes::BuildMode_t mode = BuildModes::BREADTH_FIRST);
+
+        /// Start a WEIGHTED build of `poi` into the back layer, carried out by continueBuild on the calling thread. Waits for the readers of the back layer. A finished but unpublished build is discarded
+        void beginBuild (const PointOfInterests& poi);
+
+        /// Take at most `maxCells` cells (0 for no limit) from the queue of the build started by beginBuild. Returns true once the build has finished and can be published
+        bool continueBuild (size_t maxCells);
+
+        /// Whether a build was started and has finished
+        bool ready () const;
+
+        /// Swap the buffers if the build has finished. Returns false (without blocking) while it is still running or if nothing was built. Rethrows build errors
+        bool publish ();
+
+        /// Pin the front layer. Never blocks
+        Reader read ();
+
+        /// Front layer, for callers that do not overlap queries and builds (e.g. a single threaded tick)
+        size_t layer () const {
+            return bufferLayers[front.load(std::memory_order_acquire)];
+        }
+
+    private:
+        FieldType& field;
+        size_t bufferLayers[2];
+
+        std::atomic<uint8_t> front;         // Buffer readers see
+        std::atomic<uint32_t> readers[2];   // Readers pinning each buffer
+
+        std::shared_future<void> pending;   // Build of the back buffer
+
+        BuildWorkspace workspace;           // Queue of the build carried out in slices
+        bool slicing;                       // A build is carried out in slices
+        bool sliced;                        // The build carried out in slices has finished
+
+    private:
+        void waitForReaders (uint8_t buffer) const;
+    };
+}
+
+#include "asyncLayer.cpp"
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+namespace flow {
+    namespace BuildModes {
+        typedef enum BuildMode_t : uint8_t {
+            /* Build mode enum.
+             *
+             * BREADTH_FIRST: Every passable cell costs 1 and diagonal moves cost
+             *                the same as cardinal moves. This is the default.
+             *
+             * WEIGHTED:      Integration field built with a bucket queue (Dial's
+             *                algorithm). Moving out of a cell costs its traversal
+             *                cost (see setCost), scaled by CARDINAL_WEIGHT or
+             *                DIAGONAL_WEIGHT.
+             *
+             * BITBOARD:      Same costs as BREADTH_FIRST, expanded a wave at a
+             *                time on bitboards. Gives the same distances, but
+             *                may pick another of several equally short routes.
+             *                The layer is a BREADTH_FIRST layer afterwards.
+             *
+             * EIKONAL:       Arrival times of a front moving at any angle (fast
+             *                sweeping), with the costs of WEIGHTED. Cells also
+             *                get a continuous route vector, see getGradient.
+             */
+
+            BREADTH_FIRST = 0,
+            WEIGHTED      = 1,
+            BITBOARD      = 2,
+            EIKONAL       = 3,
+        } BuildMode_t;
+
+        /// Step weights of the WEIGHTED mode. 17/12 approximates sqrt(2) with small integers
+        static const uint32_t CARDINAL_WEIGHT = 12;
+        static const uint32_t DIAGONAL_WEIGHT = 17;
+
+        static uint32_t stepWeight (uint8_t cost, bool diagonal) {
+            return cost * (diagonal ? DIAGONAL_WEIGHT : CARDINAL_WEIGHT);
+        }
+    }
+}
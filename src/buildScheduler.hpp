@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "buildModes.hpp"
+#include "buildWorkspace.hpp"
+#include "instrumentation.hpp"
+#include "threadPool.hpp"
+
+namespace flow {
+    /* Runs batches of layer builds across the workers of a thread pool.
+     *
+     * Builds are submitted as (field, layer, points of interest) requests, of
+     * any fields, and run by run(), typically once per tick. Each worker has a
+     * queue of its own and a BuildWorkspace of its own. A worker whose queue
+     * is empty steals the most urgent build from the other queues, so every
+     * worker stays busy until the batch is done.
+     *
+     * Builds run in order of priority. With a time budget, a build is only
+     * started if it is expected to end within the budget, from the duration of
+     * the previous build of the same layer. Builds that are not started are
+     * deferred to the next run, one priority step higher for every deferral so
+     * low priorities are not postponed forever. Builds whose priority reaches
+     * requiredPriority() always run, and so does the first build of a run, even
+     * if it alone takes longer than the budget. A started build is never
+     * interrupted.
+     *
+     * A second request for a layer that is still queued replaces the first
+     * one, so a layer is never built by two workers at once. Fields must not
+     * be changed or queried while run() builds them.
+     *
+     * Different layers of a field may be built at once, which streamed fields
+     * (see TileFileCells) do not support: their tiles are loaded by one thread
+     * at a time. Build them with addPointOfInterest, or with a scheduler on a
+     * pool of one thread.
+     *
+     * When a build throws, run() rethrows the exception once the other
+     * workers are done. The build that threw is dropped, and builds that were
+     * not started stay queued for the next run.
+     */
+    class BuildScheduler {
+    public:
+        /// Timing of a build run by the latest run()
+        struct JobReport {
+            const void * field;
+            size_t layer;
+            int priority;       // Priority of the request, before deferrals
+            size_t deferrals;   // Runs the build was deferred by
+            size_t worker;
+            double startMs;     // Since the start of run()
+            double buildMs;
+        };
+
+    public:
+        explicit BuildScheduler (ThreadPool& _pool) :
+            pool(_pool),
+            queues(new WorkerQueue[_pool.size()]),
+            workspaces(_pool.size()),
+            required(std::numeric_limits<int>::max())
+        {}
+
+        BuildScheduler (const BuildScheduler&) = delete;
+        BuildScheduler& operator= (const BuildScheduler&) = delete;
+
+        /// Queue a build of `layer` towards `poi`. Higher priorities run first
+        template <typename FieldType>
+        void submit (FieldType& field, size_t layer, const typename FieldType::PointOfInterests& poi, int priority = 0, BuildModes::BuildMode_t mode = BuildModes::BREADTH_FIRST) {
+            if (layer >= field.layerCount())
+                throw std::range_error("Layer out of range");
+
+            auto build = [&field, layer, poi, mode] (BuildWorkspace& workspace) {
+                field.addPointOfInterest(layer, poi, mode, workspace);
+            };
+
+            for (auto& job : pending) {
+                if (job.field == &field && job.layer == layer) {
+                    job.build = build;
+                    job.priority = std::max(job.priority, priority);
+                    return;
+                }
+            }
+
+            pending.push_back({&field, layer, priority, 0, build});
+        }
+
+        /// Builds with at least this priority (deferrals included) are never deferred. None by default
+        void requiredPriority (int priority) {
+            required = priority;
+        }
+
+        int requiredPriority () const {
+            return required;
+        }
+
+        /// Run the queued builds, within `budgetMs` milliseconds if it is not 0. Returns the number of builds run
+        size_t run (double budgetMs = 0);
+
+        /// Builds waiting for the next run
+        size_t pendingCount () const {
+            return pending.size();
+        }
+
+        /// Builds run by the latest run, in start order
+        const std::vector<JobReport>& reports () const {
+            return jobReports;
+        }
+
+    private:
+        struct Job {
+            const void * field;
+            size_t layer;
+            int priority;
+            size_t deferrals;
+            std::function<void(BuildWorkspace&)> build;
+
+            long urgency () const {
+                return (long)priority + (long)deferrals;
+            }
+        };
+
+        struct WorkerQueue {
+            std::mutex mutex;
+            std::deque<Job *> jobs; // Most urgent first
+            std::vector<Job *> deferred;
+            std::vector<JobReport> reports;
+        };
+
+        ThreadPool& pool;
+        std::unique_ptr<WorkerQueue[]> queues;
+        std::vector<BuildWorkspace> workspaces;
+        int required;
+
+        std::vector<Job> pending;
+        std::vector<JobReport> jobReports;
+        std::map<std::pair<const void *, size_t>, double> lastBuildMs;
+
+    private:
+        /// Next build of a worker: the front of its own queue, or the most urgent front of the others. nullptr once every queue is empty
+        Job * take (size_t worker);
+    };
+
+    inline size_t BuildScheduler::run (double budgetMs) {
+        StatsTimer timer;
+        const size_t workerCount = pool.size();
+
+        std::vector<Job> batch;
+        batch.swap(pending);
+        std::stable_sort(batch.begin(), batch.end(), [] (const Job& a, const Job& b) {
+            return a.urgency() > b.urgency();
+        });
+
+        // Dealt in turn, so every queue is in priority order and holds its share of the urgent builds
+        for (size_t i = 0; i < batch.size(); ++i)
+            queues[i % workerCount].jobs.push_back(&batch[i]);
+
+        std::atomic<bool> started(false);
+
+        // A build that throws ends its worker; the batch is still settled below before the exception is rethrown
+        std::exception_ptr failure;
+        try {
+            pool.run([&] (size_t worker) {
+                auto& queue = queues[worker];
+
+                for (Job * job = take(worker); job != nullptr; job = take(worker)) {
+                    const double startMs = timer.totalMs();
+
+                    if (budgetMs > 0 && job->urgency() < required && started.exchange(true)) {
+                        const auto estimate = lastBuildMs.find(std::make_pair(job->field, job->layer));
+                        if (startMs + (estimate != lastBuildMs.end() ? estimate->second : 0.0) > budgetMs) {
+                            queue.deferred.push_back(job);
+                            continue;
+                        }
+                    }
+
+                    started = true;
+                    job->build(workspaces[worker]);
+                    queue.reports.push_back({job->field, job->layer, job->priority, job->deferrals, worker, startMs, timer.totalMs() - startMs});
+                }
+            });
+        } catch (...) {
+            failure = std::current_exception();
+        }
+
+        jobReports.clear();
+        for (size_t worker = 0; worker < workerCount; ++worker) {
+            auto& queue = queues[worker];
+
+            for (const auto& report : queue.reports) {
+                lastBuildMs[std::make_pair(report.field, report.layer)] = report.buildMs;
+                jobReports.push_back(report);
+            }
+
+            for (auto job : queue.deferred) {
+                ++job->deferrals;
+                pending.push_back(std::move(*job));
+            }
+
+            // Left over when a build threw, and run next time
+            for (auto job : queue.jobs)
+                pending.push_back(std::move(*job));
+
+            queue.reports.clear();
+            queue.deferred.clear();
+            queue.jobs.clear();
+        }
+
+        std::sort(jobReports.begin(), jobReports.end(), [] (const JobReport& a, const JobReport& b) {
+            return a.startMs < b.startMs;
+        });
+
+        if (failure)
+            std::rethrow_exception(failure);
+
+        return jobReports.size();
+    }
+
+    inline BuildScheduler::Job * BuildScheduler::take (size_t worker) {
+        {
+            std::lock_guard<std::mutex> lock(queues[worker].mutex);
+            auto& jobs = queues[worker].jobs;
+            if (!jobs.empty()) {
+                Job * job = jobs.front();
+                jobs.pop_front();
+                return job;
+            }
+        }
+
+        // Steal the front of the queue whose front is the most urgent
+        while (true) {
+            size_t victim = worker;
+            long urgency = std::numeric_limits<long>::min();
+
+            for (size_t other = 0; other < pool.size(); ++other) {
+                if (other == worker)
+                    continue;
+
+                std::lock_guard<std::mutex> lock(queues[other].mutex);
+                const auto& jobs = queues[other].jobs;
+                if (!jobs.empty() && jobs.front()->urgency() > urgency) {
+                    victim = other;
+                    urgency = jobs.front()->urgency();
+                }
+            }
+
+            if (victim == worker)
+                return nullptr;
+
+            // The front may have been taken in the meantime, then look again
+            std::lock_guard<std::mutex> lock(queues[victim].mutex);
+            auto& jobs = queues[victim].jobs;
+            if (!jobs.empty()) {
+                Job * job = jobs.front();
+                jobs.pop_front();
+                return job;
+            }
+        }
+    }
+}
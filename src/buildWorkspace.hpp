@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace flow {
+    /* FIFO of cell indices in a power of two ring buffer.
+     *
+     * The buffer doubles when it is full and is never shrunk, so once it has
+     * held the widest frontier of a map, building that map again does not
+     * allocate.
+     */
+    template <typename Index>
+    class RingQueue {
+    public:
+        inline bool empty () const {
+            return count == 0;
+        }
+
+        inline size_t size () const {
+            return count;
+        }
+
+        inline size_t capacity () const {
+            return slots.size();
+        }
+
+        inline Index front () const {
+            return buffer[head];
+        }
+
+        inline void push (size_t value) {
+            if (count == slots.size())
+                grow(count + 1);
+
+            buffer[(head + count) & mask] = (Index)value;
+            ++count;
+        }
+
+        inline void pop () {
+            head = (head + 1) & mask;
+            --count;
+        }
+
+        /// Drop the queued indices, keeping the buffer
+        void clear () {
+            head = 0;
+            count = 0;
+        }
+
+        /// Grow the buffer to hold at least `minCapacity` indices
+        void reserve (size_t minCapacity) {
+            if (minCapacity > slots.size())
+                grow(minCapacity);
+        }
+
+        /// Free the buffer
+        void release () {
+            std::vector<Index>().swap(slots);
+            buffer = nullptr;
+            mask = 0;
+            clear();
+        }
+
+    private:
+        std::vector<Index> slots;
+        Index * buffer = nullptr;
+        size_t mask = 0; // slots.size() - 1
+        size_t head = 0;
+        size_t count = 0;
+
+    private:
+        void grow (size_t minCapacity) {
+            size_t capacity = std::max<size_t>(slots.size(), 64);
+            while (capacity < minCapacity)
+                capacity *= 2;
+
+            // Unwrap the queued indices to the start of the new buffer
+            std::vector<Index> larger(capacity);
+            for (size_t i = 0; i < count; ++i)
+                larger[i] = buffer[(head + i) & mask];
+
+            slots.swap(larger);
+            buffer = slots.data();
+            mask = capacity - 1;
+            head = 0;
+        }
+    };
+
+    /// Access bitboards of an 8x8 cell tile, see Field_t::buildBitboard
+    struct AccessBoard {
+        uint64_t entry[4];  // Entry from N, E, S, W
+        uint64_t passable;
+        uint64_t diagonal;  // Passable cells with diagonal access
+    };
+
+    /// Per-cell layer masks and frontier of multi-layer builds, see Field_t::buildLayers
+    template <typename Mask>
+    struct LayerMasks {
+        std::vector<Mask> reached;
+        std::vector<Mask> pending;
+        std::vector<size_t> discovered;
+        std::vector<std::pair<size_t, Mask>> frontier;
+
+        size_t memoryUsage () const {
+            return (reached.capacity() + pending.capacity()) * sizeof(Mask) + discovered.capacity() * sizeof(size_t) + frontier.capacity() * sizeof(std::pair<size_t, Mask>);
+        }
+
+        void release () {
+            std::vector<Mask>().swap(reached);
+            std::vector<Mask>().swap(pending);
+            std::vector<size_t>().swap(discovered);
+            std::vector<std::pair<size_t, Mask>>().swap(frontier);
+        }
+    };
+
+    /// Progress of a weighted build carried out in slices, see Field_t::continueBuild
+    struct WeightedProgress {
+        size_t layer = (size_t)(-1); // Layer being built, (size_t)(-1) when no build is under way
+        uint8_t buildId = 0;
+        uint32_t current = 0;        // Distance of the bucket being scanned
+        size_t position = 0;         // Next entry of that bucket
+        size_t pending = 0;          // Entries queued in every bucket
+    };
+
+    /* Scratch buffers of the builds.
+     *
+     * Buffers keep their capacity between builds, so rebuilding a map whose
+     * frontier and size do not grow makes no heap allocation. This holds for
+     * the single-layer builds of every mode and for multi-layer builds. Builds
+     * across a thread pool and repairs (updateCells) allocate on every call. A
+     * workspace must only be used by one build at a time. Builds use the
+     * workspace of the calling thread (see local()) unless they are given one.
+     */
+    class BuildWorkspace {
+    public:
+        /// Frontier of breadth-first builds. Cell indices are 32 bit, halving the queue of most maps
+        RingQueue<uint32_t> frontier;
+
+        /// Frontier of breadth-first builds of storages with 2^32 cells or more
+        RingQueue<size_t> wideFrontier;
+
+        /// Integration field of weighted builds. Swapped with the distance plane of layers that keep distances
+        std::vector<uint32_t> distances;
+
+        /// Bucket queue of weighted builds
+        std::vector<std::vector<size_t>> buckets;
+
+        /// Weighted build under way, between Field_t::beginBuild and the end of its last slice
+        WeightedProgress weighted;
+
+        /// Arrival times of eikonal builds, and the row order access bytes (also read by bitboard builds), costs, fixed and active cells they sweep
+        std::vector<float> arrivalTimes;
+        std::vector<uint8_t> access;
+        std::vector<uint8_t> costs;
+        std::vector<uint8_t> fixed;
+        std::vector<uint8_t> active;
+
+        /// Binary heap of the initial guess of eikonal builds
+        std::vector<std::pair<float, size_t>> arrivalHeap;
+
+        /// Distance level being expanded and the next one, of breadth-first builds of streamed storages
+        std::vector<size_t> level;
+        std::vector<size_t> nextLevel;
+
+        /// Tiles of bitboard builds: access, reached cells, frontier and next wave, and the wave that last listed each tile
+        std::vector<AccessBoard> accessBoards;
+        std::vector<uint64_t> reachedBoards;
+        std::vector<uint64_t> frontierBoards;
+        std::vector<uint64_t> nextBoards;
+        std::vector<uint32_t> tileVisits;
+
+        /// Frontier tiles of bitboard builds, the next ones and the tiles around them
+        std::vector<size_t> activeTiles;
+        std::vector<size_t> nextActiveTiles;
+        std::vector<size_t> candidateTiles;
+
+        /// Layers listed by a multi-layer build
+        std::vector<bool> listedLayers;
+
+    public:
+        /// Workspace of the calling thread, used by builds that are not given one
+        static BuildWorkspace& local () {
+            static thread_local BuildWorkspace workspace;
+            return workspace;
+        }
+
+        /// Bytes reserved by the buffers
+        size_t memoryUsage () const {
+            size_t bytes = frontier.capacity() * sizeof(uint32_t) + wideFrontier.capacity() * sizeof(size_t);
+            bytes += distances.capacity() * sizeof(uint32_t);
+            for (const auto& bucket : buckets)
+                bytes += bucket.capacity() * sizeof(size_t);
+
+            bytes += arrivalTimes.capacity() * sizeof(float) + access.capacity() + costs.capacity() + fixed.capacity() + active.capacity();
+            bytes += arrivalHeap.capacity() * sizeof(std::pair<float, size_t>);
+            bytes += (level.capacity() + nextLevel.capacity()) * sizeof(size_t);
+            bytes += accessBoards.capacity() * sizeof(AccessBoard) + (reachedBoards.capacity() + frontierBoards.capacity() + nextBoards.capacity()) * sizeof(uint64_t);
+            bytes += tileVisits.capacity() * sizeof(uint32_t) + (activeTiles.capacity() + nextActiveTiles.capacity() + candidateTiles.capacity()) * sizeof(size_t);
+            bytes += listedLayers.capacity() / 8;
+            bytes += masks8.memoryUsage() + masks16.memoryUsage() + masks32.memoryUsage() + masks64.memoryUsage();
+
+            return bytes;
+        }
+
+        /// Free every buffer, e.g. after building a map much larger than the usual ones
+        void release () {
+            frontier.release();
+            wideFrontier.release();
+            std::vector<uint32_t>().swap(distances);
+            std::vector<std::vector<size_t>>().swap(buckets);
+            weighted = WeightedProgress();
+            std::vector<float>().swap(arrivalTimes);
+            std::vector<uint8_t>().swap(access);
+            std::vector<uint8_t>().swap(costs);
+            std::vector<uint8_t>().swap(fixed);
+            std::vector<uint8_t>().swap(active);
+            std::vector<std::pair<float, size_t>>().swap(arrivalHeap);
+            std::vector<size_t>().swap(level);
+            std::vector<size_t>().swap(nextLevel);
+            std::vector<AccessBoard>().swap(accessBoards);
+            std::vector<uint64_t>().swap(reachedBoards);
+            std::vector<uint64_t>().swap(frontierBoards);
+            std::vector<uint64_t>().swap(nextBoards);
+            std::vector<uint32_t>().swap(tileVisits);
+            std::vector<size_t>().swap(activeTiles);
+            std::vector<size_t>().swap(nextActiveTiles);
+            std::vector<size_t>().swap(candidateTiles);
+            std::vector<bool>().swap(listedLayers);
+            masks8.release();
+            masks16.release();
+            masks32.release();
+            masks64.release();
+        }
+
+        /// Layer masks of multi-layer builds of up to 8, 16, 32 or 64 layers
+        template <typename Mask>
+        LayerMasks<Mask>& layerMasks () {
+            return masksOf((Mask)0);
+        }
+
+    private:
+        LayerMasks<uint8_t> masks8;
+        LayerMasks<uint16_t> masks16;
+        LayerMasks<uint32_t> masks32;
+        LayerMasks<uint64_t> masks64;
+
+    private:
+        LayerMasks<uint8_t>& masksOf (uint8_t) { return masks8; }
+        LayerMasks<uint16_t>& masksOf (uint16_t) { return masks16; }
+        LayerMasks<uint32_t>& masksOf (uint32_t) { return masks32; }
+        LayerMasks<uint64_t>& masksOf (uint64_t) { return masks64; }
+    };
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <memory>
+
+#include "directions.hpp"
+
+namespace flow {
+    template <size_t maxNavLayer>
+    class FieldCell;
+
+    /* Array-of-structures cell storage. Every cell is a FieldCell holding the
+     * access data and all of its direction layers. This is the default storage
+     * of Field_t.
+     *
+     * The cells are allocated once, with Allocator, e.g. from an arena:
+     * Field_t<uint16_t, 1, CellArray<1, ArenaAllocator<FieldCell<1>>>> field(width, height, arena)
+     */
+    template <size_t maxNavLayer, typename Allocator = std::allocator<FieldCell<maxNavLayer>>>
+    class CellArray {
+    public:
+        using value_type = FieldCell<maxNavLayer>;
+        using reference  = value_type&;
+        using pointer    = value_type*;
+        using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>;
+
+        /// Every cell is in memory, see TileFileCells
+        static const bool streamed = false;
+
+    public:
+        explicit CellArray (size_t _cellCount, const allocator_type& _allocator = allocator_type()) :
+            cellCount(_cellCount),
+            allocator(_allocator)
+        {
+            cells = AllocatorTraits::allocate(allocator, _cellCount);
+            for (size_t i = 0; i < _cellCount; ++i)
+                AllocatorTraits::construct(allocator, cells + i);
+        }
+
+        ~CellArray () {
+            for (size_t i = 0; i < cellCount; ++i)
+                AllocatorTraits::destroy(allocator, cells + i);
+            AllocatorTraits::deallocate(allocator, cells, cellCount);
+        }
+
+        CellArray (const CellArray&) = delete;
+        CellArray& operator= (const CellArray&) = delete;
+
+        inline reference operator[] (size_t idx) {
+            return cells[idx];
+        }
+
+        inline value_type operator[] (size_t idx) const {
+            return cells[idx];
+        }
+
+        /// Pointer to a cell, used by the field iterator
+        inline pointer address (size_t idx) {
+            return &cells[idx];
+        }
+
+        /// Address of the direction byte of the first cell. Consecutive cells are directionStride() bytes apart
+        inline const uint8_t * directionData (size_t layer) const {
+            return &cells[0].directions[layer];
+        }
+
+        inline size_t directionStride () const {
+            return sizeof(value_type);
+        }
+
+        inline size_t size () const {
+            return cellCount;
+        }
+
+        inline size_t layerCount () const {
+            return maxNavLayer;
+        }
+
+        /// Bytes used by the cells
+        inline size_t memoryUsage () const {
+            return cellCount * sizeof(value_type);
+        }
+
+        /// Set the access data of `count` cells from `first` to `in[i]`, or to `lookup[in[i]]` with a lookup table
+        void writeAccess (size_t first, size_t count, const uint8_t * in, const uint8_t * lookup) {
+            for (size_t i = 0; i < count; ++i)
+                cells[first + i].cellData.accessDirection.data = (lookup != nullptr ? lookup[in[i]] : in[i]) & ACCESS_MASK;
+        }
+
+        void readAccess (size_t first, size_t count, uint8_t * out) const {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = (uint8_t)cells[first + i].cellData.accessDirection.data.to_ulong();
+        }
+
+        void writeCosts (size_t first, size_t count, const uint8_t * in) {
+            for (size_t i = 0; i < count; ++i)
+                cells[first + i].traversalCost = in[i];
+        }
+
+        void readCosts (size_t first, size_t count, uint8_t * out) const {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = cells[first + i].traversalCost;
+        }
+
+        /// Reset the build ID of every cell of a layer to 0, see Field_t::nextBuildId
+        void clearBuildIds (size_t layer) {
+            for (size_t i = 0; i < cellCount; ++i)
+                cells[i].setBuildId(layer, 0);
+        }
+
+    private:
+        using AllocatorTraits = std::allocator_traits<allocator_type>;
+
+        size_t cellCount;
+        allocator_type allocator;
+        value_type * cells;
+    };
+}
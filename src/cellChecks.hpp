@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdexcept>
+
+/* Layer check of the cell handles (FieldCell, PlanarCell, TileFileCell).
+ *
+ * It runs on every cell access, so it is only compiled into debug builds
+ * (without NDEBUG). Expects the handle's maxLayer().
+ */
+#ifndef NDEBUG
+#define FLOW_VALIDATE_LAYER(layer) if (layer >= maxLayer())\
+                                       throw std::range_error("Layer out of range")
+#else
+#define FLOW_VALIDATE_LAYER(layer)
+#endif
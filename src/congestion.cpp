@@ -0,0 +1,280 @@
+#include "congestion.hpp"
+
+#ifndef congestion_cpp
+#define congestion_cpp
+
+#include <algorithm>
+#include <stdexcept>
+
+#define NULL_GUARD(i) if (i == nullptr)\
+                             throw std::runtime_error("NULL pointer exception")
+
+namespace flow {
+
+template <typename F>
+CongestionField<F>::CongestionField (F& _field, size_t _blockSize) :
+    field(_field),
+    block(_blockSize),
+    blocksX(0),
+    blocksY(0),
+    perAgent(4),
+    minChange(2),
+    baseCosts((size_t)_field.width * _field.height),
+    costVersion(1),
+    changed(0)
+{
+    if (_blockSize == 0)
+        throw std::invalid_argument("Block size must be at least 1");
+
+    blocksX = ((size_t)field.width + block - 1) / block;
+    blocksY = ((size_t)field.height + block - 1) / block;
+    counts.assign(blocksX * blocksY, 0);
+    applied.assign(blocksX * blocksY, 0);
+    stale.assign(blocksX * blocksY, 0);
+    rewritten.assign(blocksX * blocksY, 0);
+
+    if (!baseCosts.empty())
+        field.exportCosts(baseCosts.data());
+}
+
+template <typename F>
+void CongestionField<F>::loadBaseCosts (const uint8_t * costs) {
+    NULL_GUARD(costs);
+
+    std::copy(costs, costs + baseCosts.size(), baseCosts.begin());
+    stale.assign(stale.size(), 1);
+}
+
+template <typename F>
+void CongestionField<F>::clear () {
+    std::fill(counts.begin(), counts.end(), 0);
+}
+
+template <typename F>
+void CongestionField<F>::splat (size_t count, const float * x, const float * y) {
+    NULL_GUARD(x);
+    NULL_GUARD(y);
+
+    const float width = (float)field.width;
+    const float height = (float)field.height;
+
+    for (size_t i = 0; i < count; ++i) {
+        // Also rejects NaN
+        if (!(x[i] >= 0.0f && y[i] >= 0.0f && x[i] < width && y[i] < height))
+            continue;
+
+        ++counts[blockOf((size_t)x[i], (size_t)y[i])];
+    }
+}
+
+template <typename F>
+void CongestionField<F>::track (size_t layer, const PointOfInterests& poi) {
+    if (layer >= field.layerCount())
+        throw std::range_error("Layer out of range");
+
+    for (auto& entry : tracked) {
+        if (entry.layer == layer && !entry.buffers) {
+            entry.poi = poi;
+            entry.version = 0;
+            return;
+        }
+    }
+
+    untrack(layer);
+    tracked.push_back({layer, poi, 0, std::vector<uint8_t>(), nullptr, layer, 0, 0});
+}
+
+template <typename F>
+void CongestionField<F>::track (size_t layer, size_t backLayer, const PointOfInterests& poi) {
+    // Keep the buffers, so that readers keep the front layer until the next publish
+    for (auto& entry : tracked) {
+        if (entry.layer == layer && entry.buffers && entry.backLayer == backLayer) {
+            entry.poi = poi;
+            entry.version = 0;
+            entry.buildVersion = 0;
+            return;
+        }
+    }
+
+    std::unique_ptr<AsyncLayer<F>> buffers(new AsyncLayer<F>(field, layer, backLayer));
+    untrack(layer);
+    tracked.push_back({layer, poi, 0, std::vector<uint8_t>(), std::move(buffers), backLayer, 0, 0});
+}
+
+template <typename F>
+void CongestionField<F>::untrack (size_t layer) {
+    tracked.erase(std::remove_if(tracked.begin(), tracked.end(), [&](const TrackedLayer& entry) {
+        return entry.layer == layer;
+    }), tracked.end());
+}
+
+template <typename F>
+size_t CongestionField<F>::front (size_t layer) const {
+    for (const auto& entry : tracked)
+        if (entry.layer == layer && entry.buffers)
+            return entry.buffers->layer();
+
+    return layer;
+}
+
+template <typename F>
+size_t CongestionField<F>::update (size_t maxRebuilds, size_t maxCells) {
+    changed = 0;
+    for (size_t blockIdx = 0; blockIdx < counts.size(); ++blockIdx) {
+        const uint32_t moved = counts[blockIdx] > applied[blockIdx] ? counts[blockIdx] - applied[blockIdx] : applied[blockIdx] - counts[blockIdx];
+        if (moved <= minChange && !stale[blockIdx])
+            continue;
+
+        // Blocks rewritten by this update get the next version
+        applied[blockIdx] = counts[blockIdx];
+        stale[blockIdx] = 0;
+        rewritten[blockIdx] = costVersion + 1;
+        writeBlockCosts(blockIdx);
+        ++changed;
+    }
+
+    if (changed > 0)
+        ++costVersion;
+
+    // Layers whose region was rewritten since their build, the longest waiting first
+    std::vector<TrackedLayer *> rebuilds;
+    TrackedLayer * sliced = nullptr;
+    for (auto& entry : tracked) {
+        if (entry.buildVersion != 0)
+            sliced = &entry;
+        else if (outdated(entry))
+            rebuilds.push_back(&entry);
+        else
+            entry.version = costVersion;
+    }
+
+    std::stable_sort(rebuilds.begin(), rebuilds.end(), [](const TrackedLayer * a, const TrackedLayer * b) {
+        return a->version < b->version;
+    });
+
+    size_t rebuilt = 0;
+    for (auto entry : rebuilds) {
+        // One layer at a time is rebuilt behind its back layer, with the costs of the update that starts it
+        if (entry->buffers) {
+            if (sliced == nullptr) {
+                entry->buffers->beginBuild(entry->poi);
+                entry->buildVersion = costVersion;
+                entry->scanned = 0;
+                sliced = entry;
+            }
+            continue;
+        }
+
+        if (maxRebuilds != 0 && rebuilt == maxRebuilds)
+            continue;
+
+        field.addPointOfInterest(entry->layer, entry->poi, BuildModes::WEIGHTED);
+        entry->version = costVersion;
+        entry->scanned = 0;
+        scanRegion(*entry, entry->layer, 0);
+        ++rebuilt;
+    }
+
+    if (sliced != nullptr && advance(*sliced, maxCells))
+        ++rebuilt;
+
+    return rebuilt;
+}
+
+template <typename F>
+bool CongestionField<F>::advance (TrackedLayer& entry, size_t maxCells) {
+    const size_t back = entry.buffers->layer() == entry.layer ? entry.backLayer : entry.layer;
+
+    // The region is scanned from the next update, unless the update has no limit
+    if (!entry.buffers->ready())
+        if (!entry.buffers->continueBuild(maxCells) || maxCells != 0)
+            return false;
+
+    if (!scanRegion(entry, back, maxCells))
+        return false;
+
+    entry.buffers->publish();
+    entry.version = entry.buildVersion;
+    entry.buildVersion = 0;
+    return true;
+}
+
+template <typename F>
+bool CongestionField<F>::outdated (const TrackedLayer& entry) const {
+    if (entry.version == 0)
+        return true;
+
+    if (entry.version == costVersion)
+        return false;
+
+    for (size_t blockIdx = 0; blockIdx < rewritten.size(); ++blockIdx)
+        if (entry.region[blockIdx] && rewritten[blockIdx] > entry.version)
+            return true;
+
+    return false;
+}
+
+/* Region scans.
+ *
+ * A block is in the region as soon as one of its cells is reached, so the
+ * scan of a block stops at its first reached cell. Wherever routes cover
+ * the map, that is one of the first cells of the block, and a scan reads
+ * about one cell per block. Only blocks without any route are read whole.
+ */
+template <typename F>
+bool CongestionField<F>::scanRegion (TrackedLayer& entry, size_t layer, size_t maxCells) {
+    if (entry.scanned == 0)
+        entry.region.assign(rewritten.size(), 0);
+
+    size_t cellsScanned = 0;
+    auto reached = [&](size_t blockIdx) {
+        const size_t x0 = blockIdx % blocksX * block;
+        const size_t y0 = blockIdx / blocksX * block;
+        const size_t x1 = std::min<size_t>(x0 + block, field.width);
+        const size_t y1 = std::min<size_t>(y0 + block, field.height);
+
+        for (size_t y = y0; y < y1; ++y) {
+            for (size_t x = x0; x < x1; ++x) {
+                ++cellsScanned;
+                if (field.isReached(layer, x, y))
+                    return true;
+            }
+        }
+
+        return false;
+    };
+
+    for (; entry.scanned < entry.region.size(); ++entry.scanned) {
+        if (maxCells != 0 && cellsScanned >= maxCells)
+            return false;
+
+        entry.region[entry.scanned] = reached(entry.scanned);
+    }
+
+    return true;
+}
+
+template <typename F>
+void CongestionField<F>::writeBlockCosts (size_t blockIdx) {
+    const size_t x0 = blockIdx % blocksX * block;
+    const size_t y0 = blockIdx / blocksX * block;
+    const size_t x1 = std::min<size_t>(x0 + block, field.width);
+    const size_t y1 = std::min<size_t>(y0 + block, field.height);
+
+    // Agents per cell of the block, rounded to the nearest cost step
+    const uint64_t area = (x1 - x0) * (y1 - y0);
+    const uint64_t extra = ((uint64_t)applied[blockIdx] * perAgent + area / 2) / area;
+
+    for (size_t y = y0; y < y1; ++y) {
+        for (size_t x = x0; x < x1; ++x) {
+            const uint64_t cost = baseCosts[y * field.width + x] + extra;
+            field.at(x, y).setCost((uint8_t)std::min<uint64_t>(cost, 0xFF));
+        }
+    }
+}
+
+} // namespace flow
+
+#undef NULL_GUARD
+
+#endif // congestion_cpp
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <memory>
+#include <vector>
+
+#include "asyncLayer.hpp"
+#include "buildModes.hpp"
+#include "field.hpp"
+
+namespace flow {
+    /* Traversal costs that follow the density of a crowd.
+     *
+     * Agent positions are splatted into a plane of agent counts, one count per
+     * blockSize x blockSize block of cells (1 for a count per cell). The cost
+     * of a cell is its base cost plus costPerAgent for every agent per cell of
+     * its block, up to 255. The costs of a block are only rewritten when its
+     * count has moved by more than the threshold since they were last written,
+     * so a crowd that mills around in place does not trigger any rebuild.
+     *
+     * Tracked layers are rebuilt with BuildModes::WEIGHTED by update() once
+     * the costs of their region have changed since their previous build. The
+     * region of a layer is the set of blocks holding a cell its previous build
+     * reached: costs only weigh routes, so the other blocks cannot change the
+     * layer. A busy corridor then costs more than a free detour of about the
+     * same length, and the agents spread over both. On a map where every cell
+     * leads to every goal, every block is in every region.
+     *
+     * A layer tracked with a back layer is rebuilt behind an AsyncLayer: the
+     * build is carried out in the back layer, at most maxCells cells per
+     * update, while agents keep following the front layer. Its region is then
+     * scanned, at most about maxCells cells per update too, and the back layer
+     * is published. One such layer is rebuilt at a time, so the work of an
+     * update is bounded whatever the size of the map. Layers tracked without a
+     * back layer are rebuilt in place, in one update; bound their work with
+     * the maxRebuilds argument.
+     *
+     * The field must not be queried or built by other threads during update().
+     */
+    template <typename FieldType>
+    class CongestionField {
+    public:
+        using PointOfInterests = typename FieldType::PointOfInterests;
+
+    public:
+        /// Follow the costs of `_field` at the time of the call as the base costs
+        explicit CongestionField (FieldType& _field, size_t _blockSize = 8);
+
+        CongestionField (const CongestionField&) = delete;
+        CongestionField& operator= (const CongestionField&) = delete;
+
+        /// Cost added for every agent per cell of a block. 4 by default
+        void costPerAgent (uint32_t cost) {
+            perAgent = cost;
+            stale.assign(stale.size(), 1);
+        }
+
+        /// Agents a block count has to move by before its costs are rewritten. 2 by default
+        void threshold (uint32_t agents) {
+            minChange = agents;
+        }
+
+        /// Replace the base costs with width * height bytes in row order. The congestion term is added on top
+        void loadBaseCosts (const uint8_t * costs);
+
+        /// Forget the agents of the previous tick
+        void clear ();
+
+        /// Add `count` agents at float positions (cell (x, y) covers [x, x + 1) x [y, y + 1)). Agents outside the field are ignored
+        void splat (size_t count, const float * x, const float * y);
+
+        /// Agents counted in the block of a cell
+        uint32_t density (size_t x, size_t y) const {
+            return counts[blockOf(x, y)];
+        }
+
+        size_t blockSize () const {
+            return block;
+        }
+
+        /// Rebuild `layer` in place towards `poi` whenever the costs change. The first build happens on the next update
+        void track (size_t layer, const PointOfInterests& poi);
+
+        /// Rebuild `layer` towards `poi` whenever the costs change, in slices behind `backLayer`. Query the layer given by front(layer). The first build is published after the next updates
+        void track (size_t layer, size_t backLayer, const PointOfInterests& poi);
+
+        void untrack (size_t layer);
+
+        /// Layer holding the latest routes of a tracked layer: the layer itself or its back layer
+        size_t front (size_t layer) const;
+
+        /// Rewrite the costs of the blocks whose count moved by more than the threshold, then rebuild the tracked layers whose region changed since their build, the longest waiting first. At most `maxRebuilds` layers are rebuilt in place (0 for no limit), the others wait for the next update. The layer rebuilt behind its back layer takes at most `maxCells` cells (0 for no limit) from its build queue, or scans about as many for its region. Returns the number of layers rebuilt in place or published
+        size_t update (size_t maxRebuilds = 0, size_t maxCells = 0);
+
+        /// Number of blocks whose costs were rewritten by the latest update
+        size_t changedBlocks () const {
+            return changed;
+        }
+
+    private:
+        struct TrackedLayer {
+            size_t layer;
+            PointOfInterests poi;
+            uint64_t version;            // Cost version the layer was built with, 0 if never built
+            std::vector<uint8_t> region; // Blocks holding a cell the build reached
+
+            std::unique_ptr<AsyncLayer<FieldType>> buffers; // Front and back layer, null for layers rebuilt in place
+            size_t backLayer;
+            uint64_t buildVersion;       // Cost version the back layer is built with, 0 if no build is under way
+            size_t scanned;              // Blocks of the region of the back layer scanned so far
+        };
+
+        FieldType& field;
+        size_t block;
+        size_t blocksX;
+        size_t blocksY;
+
+        uint32_t perAgent;
+        uint32_t minChange;
+
+        std::vector<uint8_t> baseCosts;  // Row order
+        std::vector<uint32_t> counts;    // Agents per block in the current tick
+        std::vector<uint32_t> applied;   // Agents per block the costs were written for
+        std::vector<uint8_t> stale;      // Blocks whose costs must be rewritten whatever their count
+        std::vector<uint64_t> rewritten; // Cost version at which each block was last rewritten
+
+        std::vector<TrackedLayer> tracked;
+        uint64_t costVersion;
+        size_t changed;
+
+    private:
+        size_t blockOf (size_t x, size_t y) const {
+            return (y / block) * blocksX + x / block;
+        }
+
+        void writeBlockCosts (size_t blockIdx);
+
+        /// Whether costs of the region of a layer were rewritten since its build
+        bool outdated (const TrackedLayer& entry) const;
+
+        /// Record the blocks reached by the latest build of `layer`, from block `entry.scanned` on, scanning about `maxCells` cells at most (0 for no limit). Returns true once every block was scanned
+        bool scanRegion (TrackedLayer& entry, size_t layer, size_t maxCells);
+
+        /// Start, continue, scan and publish the build of a layer tracked with a back layer. Returns true once it was published
+        bool advance (TrackedLayer& entry, size_t maxCells);
+    };
+}
+
+#include "congestion.cpp"
@@ -0,0 +1,188 @@
+#include "crowd.hpp"
+
+#ifndef crowd_cpp
+#define crowd_cpp
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Minimum number of agents handed to a worker. Smaller crowds are stepped on the calling thread
+#define CROWD_GRAIN 4096
+
+namespace flow {
+
+template <typename F>
+size_t CrowdStepper<F>::step (size_t count, float * x, float * y, const float * speed, const uint16_t * layer, std::vector<size_t>& arrived) {
+    if (x == nullptr || y == nullptr || speed == nullptr || layer == nullptr)
+        throw std::runtime_error("NULL pointer exception");
+
+    for (size_t i = 0; i < count; ++i) {
+        if (layer[i] >= field.layerCount())
+            throw std::range_error("Layer out of range");
+    }
+
+    return advance({x, y, speed, layer, 0}, count, arrived);
+}
+
+template <typename F>
+size_t CrowdStepper<F>::step (size_t layer, size_t count, float * x, float * y, const float * speed, std::vector<size_t>& arrived) {
+    if (x == nullptr || y == nullptr || speed == nullptr)
+        throw std::runtime_error("NULL pointer exception");
+
+    if (layer >= field.layerCount())
+        throw std::range_error("Layer out of range");
+
+    return advance({x, y, speed, nullptr, layer}, count, arrived);
+}
+
+template <typename F>
+size_t CrowdStepper<F>::advance (const Agents& agents, size_t count, std::vector<size_t>& arrived) {
+    if (sorted.size() != count || (interval != 0 && ++stepsSinceSort >= interval)) {
+        if (interval != 0) {
+            sortAgents(agents, count);
+        } else {
+            sorted.resize(count);
+            for (size_t i = 0; i < count; ++i)
+                sorted[i] = i;
+        }
+        stepsSinceSort = 0;
+    }
+
+    const size_t workerCount = (pool != nullptr && count >= CROWD_GRAIN * 2) ? std::min(pool->size(), count / CROWD_GRAIN) : 1;
+    arrivals.resize(std::max(arrivals.size(), workerCount));
+
+    auto work = [&](size_t worker) {
+        if (worker >= workerCount)
+            return;
+
+        auto& reached = arrivals[worker];
+        reached.clear();
+
+        const size_t end = count * (worker + 1) / workerCount;
+        for (size_t i = count * worker / workerCount; i < end; ++i) {
+            const size_t agent = sorted[i];
+            const size_t layer = agents.layer != nullptr ? agents.layer[agent] : agents.commonLayer;
+
+            if (moveAgent(field.cells.directionData(layer), field.cells.directionStride(), agents.x[agent], agents.y[agent], agents.speed[agent]))
+                reached.push_back(agent);
+        }
+    };
+
+    if (workerCount > 1)
+        pool->run(work);
+    else
+        work(0);
+
+    arrived.clear();
+    for (size_t worker = 0; worker < workerCount; ++worker)
+        arrived.insert(arrived.end(), arrivals[worker].begin(), arrivals[worker].end());
+    std::sort(arrived.begin(), arrived.end());
+
+    return arrived.size();
+}
+
+/* Agents are bucketed by layer and cell with a counting sort, so a sort is
+ * linear in the number of agents. A bucket covers a power of two run of
+ * (layer, storage index) keys, sized so there are at most about as many
+ * buckets as agents.
+ */
+template <typename F>
+void CrowdStepper<F>::sortAgents (const Agents& agents, size_t count) {
+    const uint64_t keySpace = (uint64_t)field.layerCount() * field.cells.size();
+    size_t shift = 0;
+    while ((keySpace >> shift) > count)
+        ++shift;
+
+    const size_t bucketCount = (size_t)((keySpace >> shift) + 1);
+
+    buckets.resize(count);
+    for (size_t agent = 0; agent < count; ++agent) {
+        const size_t layer = agents.layer != nullptr ? agents.layer[agent] : agents.commonLayer;
+        const float x = std::min(std::max(agents.x[agent], 0.0f), (float)(field.width - 1));
+        const float y = std::min(std::max(agents.y[agent], 0.0f), (float)(field.height - 1));
+        const uint64_t key = (uint64_t)layer * field.cells.size() + field.vec2ToArrayIdx((size_t)x, (size_t)y);
+
+        buckets[agent] = (size_t)(key >> shift);
+    }
+
+    bucketStart.assign(bucketCount + 1, 0);
+    for (size_t agent = 0; agent < count; ++agent)
+        ++bucketStart[buckets[agent] + 1];
+
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket)
+        bucketStart[bucket + 1] += bucketStart[bucket];
+
+    sorted.resize(count);
+    for (size_t agent = 0; agent < count; ++agent)
+        sorted[bucketStart[buckets[agent]]++] = agent;
+}
+
+template <typename F>
+bool CrowdStepper<F>::moveAgent (const uint8_t * directions, size_t stride, float& x, float& y, float speed) const {
+    Direction_t dir = directionAt(directions, stride, x, y);
+
+    for (float remaining = speed; dir != Directions::DEST && remaining > 0; ) {
+        // Walls, cells without a route and positions outside the field
+        if (dir == Directions::STOP)
+            return false;
+
+        const float move = std::min(remaining, 1.0f);
+        remaining -= move;
+
+        // Moves are scaled to unit length, so diagonal routes are walked at the same speed as straight ones
+        const float length = Directions::isDiagonal(dir) ? 1.41421356f : 1.0f;
+        float nX = x + move * Directions::stepX[dir] / length;
+        float nY = y + move * Directions::stepY[dir] / length;
+
+        if (smooth) {
+            float sX, sY;
+            field.sampleAt(directions, stride, x, y, &sX, &sY);
+
+            /* Where routes split (e.g. on both sides of an obstacle) the blend can
+             * cancel out, and next to walls it can point into them. The cell
+             * direction is followed in both cases.
+             */
+            const float sLength = std::sqrt(sX * sX + sY * sY);
+            const float tX = sLength > 0.0f ? x + move * sX / sLength : x;
+            const float tY = sLength > 0.0f ? y + move * sY / sLength : y;
+            if (sX * Directions::stepX[dir] + sY * Directions::stepY[dir] > 0.0f && directionAt(directions, stride, tX, tY) != Directions::STOP) {
+                nX = tX;
+                nY = tY;
+            }
+        }
+
+        Direction_t next = directionAt(directions, stride, nX, nY);
+
+        // Slide along the wall: keep the axis that is still free
+        if (next == Directions::STOP) {
+            if ((next = directionAt(directions, stride, nX, y)) != Directions::STOP)
+                nY = y;
+            else if ((next = directionAt(directions, stride, x, nY)) != Directions::STOP)
+                nX = x;
+            else
+                return false;
+        }
+
+        x = nX;
+        y = nY;
+        dir = next;
+    }
+
+    return dir == Directions::DEST;
+}
+
+template <typename F>
+Direction_t CrowdStepper<F>::directionAt (const uint8_t * directions, size_t stride, float x, float y) const {
+    // Also rejects NaN
+    if (!(x >= 0.0f && y >= 0.0f && x < (float)field.width && y < (float)field.height))
+        return Directions::STOP;
+
+    return directions[field.vec2ToArrayIdx((size_t)x, (size_t)y) * stride] & 0xF;
+}
+
+} // namespace flow
+
+#undef CROWD_GRAIN
+
+#endif // crowd_cpp
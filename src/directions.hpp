@@ -3,6 +3,9 @@
 namespace flow {
     typedef uint8_t Direction_t;
 
+    /// Bits of a cell's access byte in use: 0-3 entry directions, 4 diagonal access
+    static const uint8_t ACCESS_MASK = 0x1F;
+
     namespace Directions {
         typedef enum Directions_t : Direction_t {
             /* Cardinal direction enum.
@@ -43,7 +46,7 @@ namespace flow {
             DEST       = 0XF,
         } DirectionControl_t;
 
-        static Direction_t negateDir (Direction_t dir) {
+        inline Direction_t negateDir (Direction_t dir) {
             // http://graphics.stanford.edu/~seander/bithacks.html#SwappingBitsXOR
             const uint8_t i = 0, j = 2; // Bit position to swap
             const uint8_t n = 2; // number of consecutive bits in each sequence
@@ -52,5 +55,45 @@ namespace flow {
             const uint8_t x = ((b >> i) ^ (b >> j)) & ((1U << n) - 1); // XOR temporary
             return (b ^ ((x << i) | (x << j)));
         }
+
+        inline bool isDiagonal (Direction_t dir) {
+            return (dir == NORTH_EAST) | (dir == SOUTH_EAST) | (dir == SOUTH_WEST) | (dir == NORTH_WEST);
+        }
+
+        /// Order in which a cell's neighbours are expanded while building a layer. Terminated by STOP
+        static const Direction_t expansionOrder[9] = {
+            NORTH,
+            EAST,
+            SOUTH,
+            WEST,
+            NORTH_WEST,
+            NORTH_EAST,
+            SOUTH_EAST,
+            SOUTH_WEST,
+            STOP,
+        };
+
+        /* Direction code to vector tables, indexed by the 4 bit direction code.
+         *
+         * Vectors are normalized the same way as Field_t::getDirection, by the
+         * number of non-zero components (diagonals are +-0.5, +-0.5). Codes that
+         * do not point anywhere (STOP, WALL, DEST and opposing bits) map to 0.
+         */
+        static const float vectorX[16] = {
+            0, 0, 1, 0.5f, 0, 0, 0.5f, 1, -1, -0.5f, 0, 0, -0.5f, -1, 0, 0,
+        };
+
+        static const float vectorY[16] = {
+            0, -1, 0, -0.5f, 1, 0, 0.5f, 0, 0, -0.5f, 0, -1, 0.5f, 0, 1, 0,
+        };
+
+        /// Cell offset of a single step in the direction
+        static const int32_t stepX[16] = {
+            0, 0, 1, 1, 0, 0, 1, 1, -1, -1, 0, 0, -1, -1, 0, 0,
+        };
+
+        static const int32_t stepY[16] = {
+            0, -1, 0, -1, 1, 0, 1, 0, 0, -1, 0, -1, 1, 0, 1, 0,
+        };
     }
 }
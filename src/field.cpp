@@ -5,16 +5,67 @@
 
 #define cellIdxToVec2(idx) (index % 3, Math.floor(index / 3))
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include "fieldCell.hpp"
 
 namespace flow {
 
-template <typename T, size_t S>
-Field_t<T, S> * Field_t<T, S>::addPointOfInterest (size_t layer, const PointOfInterests& poi) {
-    uint8_t buildId = CellType::newBuildId();
-    std::queue<size_t> cellQueue;
+template <typename T, size_t S, typename C, typename G>
+Field_t<T, S, C, G> * Field_t<T, S, C, G>::addPointOfInterest (size_t layer, const PointOfInterests& poi) {
+    return addPointOfInterest(layer, poi, BuildModes::BREADTH_FIRST, BuildWorkspace::local());
+}
+
+template <typename T, size_t S, typename C, typename G>
+Field_t<T, S, C, G> * Field_t<T, S, C, G>::addPointOfInterest (size_t layer, const PointOfInterests& poi, BuildModes::BuildMode_t mode) {
+    return addPointOfInterest(layer, poi, mode, BuildWorkspace::local());
+}
+
+template <typename T, size_t S, typename C, typename G>
+Field_t<T, S, C, G> * Field_t<T, S, C, G>::addPointOfInterest (size_t layer, const PointOfInterests& poi, BuildModes::BuildMode_t mode, BuildWorkspace& workspace) {
+    // The other modes allocate buffers of the whole map, which a streamed storage must not hold in memory
+    if (C::streamed && mode != BuildModes::BREADTH_FIRST)
+        throw std::invalid_argument("Streamed fields only build BREADTH_FIRST layers");
+
+    switch (mode) {
+        case BuildModes::WEIGHTED:
+            buildWeighted(layer, poi, workspace);
+            return this;
+
+        case BuildModes::BITBOARD:
+            buildBitboard(layer, poi, workspace);
+            return this;
+
+        case BuildModes::EIKONAL:
+            buildEikonal(layer, poi, workspace);
+            return this;
+
+        case BuildModes::BREADTH_FIRST:
+        default:
+            // Storages that load cells tile by tile are expanded in tile order
+            if (C::streamed)
+                buildStreamed(layer, poi, workspace);
+            // Cell indices are queued as 32 bit integers unless the storage has more cells
+            else if (cells.size() <= std::numeric_limits<uint32_t>::max())
+                buildBreadthFirst(layer, poi, workspace.frontier);
+            else
+                buildBreadthFirst(layer, poi, workspace.wideFrontier);
+            return this;
+    }
+}
+
+template <typename T, size_t S, typename C, typename G>
+template <typename Index>
+void Field_t<T, S, C, G>::buildBreadthFirst (size_t layer, const PointOfInterests& poi, RingQueue<Index>& cellQueue) {
+    FLOW_TRACE_EVENT(BUILD_BEGIN, layer);
+    FLOW_STATS(StatsTimer timer);
+    FLOW_STATS(BuildStats& stats = beginStats(layer, BuildModes::BREADTH_FIRST, false));
+
+    const uint8_t buildId = nextBuildId(layer);
+    uint32_t * distance = resetDistances(layer);
+    cellQueue.clear();
 
     // Load POIs to cell queue and mark them as the destination
     for (auto point : poi) {
@@ -22,139 +73,200 @@ Field_t<T, S> * Field_t<T, S>::addPointOfInterest (size_t layer, const PointOfIn
         cellQueue.push(cellIdx);
         cells[cellIdx].setDirection(layer, Directions::DEST);
         cells[cellIdx].setBuildId(layer, buildId);
+
+        if (distance != nullptr)
+            distance[cellIdx] = 0;
     }
 
-    const Direction_t directions[9] = {
-        Directions::NORTH,
-        Directions::EAST,
-        Directions::SOUTH,
-        Directions::WEST,
-        Directions::NORTH_WEST,
-        Directions::NORTH_EAST,
-        Directions::SOUTH_EAST,
-        Directions::SOUTH_WEST,
-        Directions::STOP,
-    };
+    FLOW_STATS(stats.cellsEnqueued = stats.peakQueueDepth = cellQueue.size(); stats.seedMs = timer.lapMs());
+    FLOW_TRACE_EVENT(SEED_END, layer);
+
+    const Direction_t * directions = Directions::expansionOrder;
 
     while (!cellQueue.empty()) {
         const auto cellIdx = cellQueue.front();
         cellQueue.pop();
+        FLOW_STATS(++stats.cellsVisited);
 
         for (auto i = 0; directions[i] != Directions::STOP; ++i) {
-            bool currentDirIsDiag = (directions[i] == Directions::NORTH_EAST) | (directions[i] == Directions::SOUTH_EAST) | (directions[i] == Directions::SOUTH_WEST) | (directions[i] == Directions::NORTH_WEST);
-
-            const auto neighbourCellIdx = moveIndexByDirection(cellIdx, directions[i]);
+            const auto neighbourCellIdx = expandNeighbour(layer, buildId, cellIdx, directions[i]);
             if (neighbourCellIdx != (size_t)(-1)) {
-                // Skip cell if the build ID is the same as the current build ID
-                if (cells[neighbourCellIdx].getBuildId(layer) == buildId)
-                    continue;
-
-                // Skip cell if wall. Also mark it as a wall
-                if (cells[neighbourCellIdx].isWall()) {
-                    cells[neighbourCellIdx].setBuildId(layer, buildId);
-                    cells[neighbourCellIdx].markDirAsWall(layer);
-                    continue;
-                }
-
-                // Skip diagonal if diagonal direction is not allowed
-                if (currentDirIsDiag && !cells[neighbourCellIdx].getAllowDiagonal())
-                    continue;
-
-                // Check if the direction to the current cell is valid from the neighbour or not
-                auto dirFromNeighbourToCurrentCell = Directions::negateDir(directions[i]);
-                if (!cells[cellIdx].canEnterFrom(dirFromNeighbourToCurrentCell))
-                    continue;
-
-                // All check pass. Set the direction to the current cell and mark it as part of the current build
-                cells[neighbourCellIdx].setBuildId(layer, buildId);
-                cells[neighbourCellIdx].setDirection(layer, dirFromNeighbourToCurrentCell);
                 cellQueue.push(neighbourCellIdx);
+                FLOW_STATS(++stats.cellsEnqueued);
+
+                if (distance != nullptr)
+                    distance[neighbourCellIdx] = distance[cellIdx] + 1;
             }
         }
+
+        FLOW_STATS(stats.peakQueueDepth = std::max<uint64_t>(stats.peakQueueDepth, cellQueue.size()));
     }
 
-    return this;
+    FLOW_STATS(stats.expandMs = timer.lapMs());
+    finishBuild(layer, buildId, BuildModes::BREADTH_FIRST);
+    FLOW_STATS(stats.totalMs = timer.totalMs());
+    FLOW_TRACE_EVENT(BUILD_END, layer);
 }
 
-#define NULL_GUARD(i) if (i == nullptr)\
-                             throw std::runtime_error("NULL pointer exception")
+/* Build IDs.
+ *
+ * The build ID is kept in the high nibble of a cell's direction byte, so
+ * only IDs 1 to 15 are available (0 is never issued). Each layer issues them
+ * in turn from its own generation counter, and clears the IDs left in its
+ * cells before an ID is issued a second time. A cell of an older build can
+ * therefore never match the current build, and layers or fields can be built
+ * concurrently as long as each layer is built by one thread at a time.
+ *
+ * The storage clears the IDs (see clearBuildIds). Streamed storages only clear
+ * the tiles they mapped since the previous clear, so the clear does not turn
+ * one build in 15 into a pass over the whole file.
+ */
+template <typename T, size_t S, typename C, typename G>
+uint8_t Field_t<T, S, C, G>::nextBuildId (size_t layer) {
+    auto& state = layers[layer];
+
+    if (state.generation > 0 && state.generation % 15 == 0)
+        cells.clearBuildIds(layer);
+
+    ++state.generation;
+    return (uint8_t)((state.generation - 1) % 15 + 1);
+}
 
-#define DIR2VEC(dir, x, y, mag) {\
-    x = y = 0; \
-    switch (dir & (Directions::NORTH | Directions::SOUTH)) {\
-        case Directions::NORTH:\
-            y = -1; ++mag; break;\
-        case Directions::SOUTH:\
-            y = 1; ++mag; break;\
-    }\
-\
-    switch (dir & (Directions::WEST | Directions::EAST)) {\
-        case Directions::EAST:\
-            x = 1; ++mag; break;\
-        case Directions::WEST:\
-            x = -1; ++mag; break;\
-    }\
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::keepDistances (size_t layer, bool keep) {
+    // A distance plane holds the whole map, which a streamed storage must not keep in memory
+    if (keep && C::streamed)
+        throw std::invalid_argument("Streamed fields do not keep distances");
+
+    if (!keep)
+        std::vector<uint32_t>().swap(layers[layer].distances);
+    else if (layers[layer].distances.empty())
+        layers[layer].distances.assign(cells.size(), UNREACHABLE_DISTANCE);
+}
+
+template <typename T, size_t S, typename C, typename G>
+uint32_t * Field_t<T, S, C, G>::resetDistances (size_t layer) {
+    uint32_t * distance = distancePlane(layer);
+    if (distance != nullptr)
+        std::fill(distance, distance + cells.size(), UNREACHABLE_DISTANCE);
+
+    return distance;
+}
+
+/// Passable cells that the build `buildId` did not reach
+template <typename T, size_t S, typename C, typename G>
+uint64_t Field_t<T, S, C, G>::countUnreachable (size_t layer, uint8_t buildId) {
+    uint64_t unreachable = 0;
+    for (size_t cellIdx = 0; cellIdx < cells.size(); ++cellIdx)
+        unreachable += !cells[cellIdx].isWall() && cells[cellIdx].getBuildId(layer) != buildId;
+
+    return unreachable;
+}
+
+template <typename T, size_t S, typename C, typename G>
+size_t Field_t<T, S, C, G>::expandNeighbour (size_t layer, uint8_t buildId, size_t cellIdx, Direction_t dir) {
+    const auto neighbourCellIdx = moveIndexByDirection(cellIdx, dir);
+    if (neighbourCellIdx == (size_t)(-1))
+        return -1;
+
+    // Skip cell if the build ID is the same as the current build ID
+    if (cells[neighbourCellIdx].getBuildId(layer) == buildId)
+        return -1;
+
+    // Skip cell if wall. Also mark it as a wall
+    if (cells[neighbourCellIdx].isWall()) {
+        cells[neighbourCellIdx].setBuildId(layer, buildId);
+        cells[neighbourCellIdx].markDirAsWall(layer);
+        FLOW_STATS(++layers[layer].stats.wallsMarked);
+        return -1;
+    }
+
+    // Skip diagonal if diagonal direction is not allowed
+    if (Directions::isDiagonal(dir) && !cells[neighbourCellIdx].getAllowDiagonal())
+        return -1;
+
+    // Check if the direction to the current cell is valid from the neighbour or not
+    auto dirFromNeighbourToCurrentCell = Directions::negateDir(dir);
+    if (!cells[cellIdx].canEnterFrom(dirFromNeighbourToCurrentCell))
+        return -1;
+
+    // All check pass. Set the direction to the current cell and mark it as part of the current build
+    cells[neighbourCellIdx].setBuildId(layer, buildId);
+    cells[neighbourCellIdx].setDirection(layer, dirFromNeighbourToCurrentCell);
+    return neighbourCellIdx;
 }
 
+#define NULL_GUARD(i) if (i == nullptr)\
+                             throw std::runtime_error("NULL pointer exception")
+
 /// Get cardinal direction from a coordinate
-template <typename T, size_t S>
-Direction_t Field_t<T, S>::getDirection (size_t layer, T x, T y) {
-    return cells[vec2ToArrayIdx(x, y)].getDirection(layer);
+template <typename T, size_t S, typename C, typename G>
+Direction_t Field_t<T, S, C, G>::getDirection (size_t layer, T x, T y) {
+    const auto dir = cells[vec2ToArrayIdx(x, y)].getDirection(layer);
+    FLOW_COUNT_QUERIES(layers[layer].directionQueries, 1);
+    return dir;
 }
 
 /// Get direction vector from a coordinate
-template <typename T, size_t S>
-void Field_t<T, S>::getDirection (size_t layer, T x, T y, float * vX, float * vY) {
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::getDirection (size_t layer, T x, T y, float * vX, float * vY) {
     NULL_GUARD(vX);
     NULL_GUARD(vY);
 
-    int mag = 0;
-    float _x, _y;
-    DIR2VEC(getDirection(layer, x, y), _x, _y, mag);
-    (*vX) = _x / mag;
-    (*vY) = _y / mag;
+    const auto dir = getDirection(layer, x, y);
+    (*vX) = Directions::vectorX[dir];
+    (*vY) = Directions::vectorY[dir];
 }
 
 /// Get direction vector from a coordinate
-template <typename T, size_t S>
-void Field_t<T, S>::getDirection (size_t layer, T x, T y, double * vX, double * vY) {
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::getDirection (size_t layer, T x, T y, double * vX, double * vY) {
     NULL_GUARD(vX);
     NULL_GUARD(vY);
 
-    int mag = 0;
-    double _x, _y;
-    DIR2VEC(getDirection(layer, x, y), _x, _y, mag);
-    (*vX) = _x / mag;
-    (*vY) = _y / mag;
+    const auto dir = getDirection(layer, x, y);
+    (*vX) = Directions::vectorX[dir];
+    (*vY) = Directions::vectorY[dir];
 }
 
 /// Get direction vector from a coordinate
-template <typename T, size_t S>
-void Field_t<T, S>::getDirection (size_t layer, T x, T y, int * vX, int * vY) {
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::getDirection (size_t layer, T x, T y, int * vX, int * vY) {
     NULL_GUARD(vX);
     NULL_GUARD(vY);
 
-    int mag = 0;
-    int _x, _y;
-    DIR2VEC(getDirection(layer, x, y), _x, _y, mag);
-    (*vX) = _x / mag;
-    (*vY) = _y / mag;
+    // Diagonal components are truncated to 0
+    const auto dir = getDirection(layer, x, y);
+    const bool diagonal = Directions::isDiagonal(dir);
+    (*vX) = diagonal ? 0 : Directions::stepX[dir];
+    (*vY) = diagonal ? 0 : Directions::stepY[dir];
 }
 
 /// Get the next cell's coordinate from a coordinate point
-template <typename T, size_t S>
-void Field_t<T, S>::getNextCell (size_t layer, T x, T y, T * nX, T * nY) {
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::getNextCell (size_t layer, T x, T y, T * nX, T * nY) {
     NULL_GUARD(nX);
     NULL_GUARD(nY);
 
-    int mag = 0;
-    int _x, _y;
-    DIR2VEC(getDirection(layer, x, y), _x, _y, mag);
-    (*nX) += _x;
-    (*nY) += _y;
+    const auto dir = cells[vec2ToArrayIdx(x, y)].getDirection(layer);
+    FLOW_COUNT_QUERIES(layers[layer].nextCellQueries, 1);
+    (*nX) = x + Directions::stepX[dir];
+    (*nY) = y + Directions::stepY[dir];
+}
+
+/// Get the distance to the point of interest from a coordinate
+template <typename T, size_t S, typename C, typename G>
+uint32_t Field_t<T, S, C, G>::getDistance (size_t layer, T x, T y) {
+    const uint32_t * distance = distancePlane(layer);
+    return distance != nullptr ? distance[vec2ToArrayIdx(x, y)] : UNREACHABLE_DISTANCE;
+}
+
+template <typename T, size_t S, typename C, typename G>
+bool Field_t<T, S, C, G>::isReached (size_t layer, T x, T y) {
+    const auto cellIdx = vec2ToArrayIdx(x, y);
+    return layers[layer].built && !cells[cellIdx].isWall() && cells[cellIdx].getBuildId(layer) == layers[layer].buildId;
 }
 
-#undef DIR2VEC
 #undef NULL_GUARD
 
 } // namespace flow
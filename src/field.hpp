@@ -4,20 +4,63 @@
 #include <cstddef>
 
 #include <iterator>
+#include <memory>
 #include <vector>
 #include <array>
 #include <queue>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 
 #include "directions.hpp"
+#include "buildModes.hpp"
+#include "buildWorkspace.hpp"
+#include "fieldLayout.hpp"
+#include "instrumentation.hpp"
+#include "cellArray.hpp"
+#include "planarCells.hpp"
+#include "tileFileCells.hpp"
+#include "threadPool.hpp"
 
 namespace flow {
     template <size_t maxNavLayer>
     class FieldCell;
 
+    template <typename DimensionType, size_t MaxNavLayer, size_t SectorSize>
+    class SectorField_t;
+
+    template <typename DimensionType, size_t MaxNavLayer, typename Storage>
+    class FieldWriter;
+
     template <typename DimensionType, size_t MaxNavLayer>
+    class MappedField;
+
+    template <typename FieldType>
+    class CrowdStepper;
+
+    template <typename FieldType>
+    class CongestionField;
+
+    /// Distance of cells without a route to a point of interest, see Field_t::getDistance
+    static const uint32_t UNREACHABLE_DISTANCE = (uint32_t)(-1);
+
+    /* Storage is the cell storage backend:
+     * - CellArray: array of FieldCell (default)
+     * - PlanarCells: one plane for the access data and one plane per layer
+     * - TileFileCells: planar tiles in a file, with a bounded set in memory
+     *
+     * Layout places the cells in the storage, see fieldLayout.hpp.
+     */
+    template <typename DimensionType, size_t MaxNavLayer, typename Storage = CellArray<MaxNavLayer>, typename Layout = RowMajorLayout>
     class Field_t {
+        template <typename T, size_t L, size_t Size> friend class SectorField_t;
+        template <typename T, size_t L, typename C> friend class FieldWriter;
+        template <typename T, size_t L> friend class MappedField;
+        template <typename F> friend class CrowdStepper;
+        template <typename F> friend class CongestionField;
+
     public:
-        using CellType = FieldCell<MaxNavLayer>;
+        using CellType = typename Storage::value_type;
 
         /// Target (point of interest) Vector2 represented as an array. Index 0 for x, index 1 for y
         using Vec2 = std::array<DimensionType, 2>;
@@ -25,53 +68,118 @@ namespace flow {
         /// List of point of interest
         using PointOfInterests = std::vector<Vec2>;
 
+        /// Point of interest lists of several layers, as (layer, points) pairs
+        using LayerPointOfInterests = std::vector<std::pair<size_t, PointOfInterests>>;
+
     public:
         Field_t (DimensionType _width, DimensionType _height) :
             width(_width),
-            height(_height)
-        {
-            cells = new CellType[_width * _height];
-        };
-
-        ~Field_t () {
-            delete[] cells;
-        };
+            height(_height),
+            layout(_width, _height),
+            cells(layout.cellCount()),
+            layers(new LayerState[cells.layerCount()]())
+        {};
+
+        /// Construct the storage from the cell count followed by `storageArgs`, e.g. the layer count of a DYNAMIC_LAYERS storage or the planes of a memory mapped file
+        template <typename... StorageArgs>
+        Field_t (DimensionType _width, DimensionType _height, StorageArgs&&... storageArgs) :
+            width(_width),
+            height(_height),
+            layout(_width, _height),
+            cells(layout.cellCount(), std::forward<StorageArgs>(storageArgs)...),
+            layers(new LayerState[cells.layerCount()]())
+        {};
 
         struct forward_iterator {
             using iterator_category = std::forward_iterator_tag;
             using difference_type   = std::ptrdiff_t;
             using value_type        = CellType;
-            using pointer           = value_type*;
+            using pointer           = typename Storage::pointer;
             using reference         = value_type&;
 
-            size_t idx;
+            size_t idx; // Row major position (y * width + x), whatever the layout
 
-            forward_iterator(pointer ptr) : m_ptr(ptr) {
-                idx = 0;
-            }
+            forward_iterator(Field_t * _field, size_t _idx) : idx(_idx), field(_field), m_ptr(_field->cells.address(_field->layout.storageIndex(_idx))) {}
 
             reference operator*() const { return *m_ptr; }
             pointer operator->() { return m_ptr; }
 
-            forward_iterator& operator++() { ++m_ptr; ++idx; return *this; }
-            forward_iterator operator++(int) { forward_iterator tmp = *this; ++(*this); ++idx; return tmp; }
+            forward_iterator& operator++() { ++idx; m_ptr = field->cells.address(field->layout.storageIndex(idx)); return *this; }
+            forward_iterator operator++(int) { forward_iterator tmp = *this; ++(*this); return tmp; }
 
-            friend bool operator== (const forward_iterator& a, const forward_iterator& b) { return a.m_ptr == b.m_ptr; };
-            friend bool operator!= (const forward_iterator& a, const forward_iterator& b) { return a.m_ptr != b.m_ptr; };
+            friend bool operator== (const forward_iterator& a, const forward_iterator& b) { return a.idx == b.idx; };
+            friend bool operator!= (const forward_iterator& a, const forward_iterator& b) { return a.idx != b.idx; };
 
         private:
+            Field_t * field;
             pointer m_ptr;
         };
 
         forward_iterator begin () {
-            return forward_iterator(&cells[0]);
+            return forward_iterator(this, 0);
         }
 
         forward_iterator end () {
-            return forward_iterator(&cells[width * height]);
+            return forward_iterator(this, (size_t)width * height);
         }
 
-        Field_t<DimensionType, MaxNavLayer> * addPointOfInterest (size_t layer, const PointOfInterests& poi);
+        /// Bytes used by the cell storage
+        size_t memoryUsage () const {
+            return cells.memoryUsage();
+        }
+
+        /// Number of layers. MaxNavLayer, unless the storage was given a layer count at runtime
+        size_t layerCount () const {
+            return cells.layerCount();
+        }
+
+        /// Set the access data of every cell from width * height bytes in row order (y * width + x), in the bit layout of FieldCell: 0-3 entry directions, 4 diagonal access. Built layers must be rebuilt or repaired afterwards
+        void loadAccess (const uint8_t * access);
+
+        /// Same, translating every byte through `lookup` (256 access bytes), e.g. an ASCII map with lookup['.'] set to an open cell
+        void loadAccess (const uint8_t * map, const uint8_t * lookup);
+
+        void loadAccess (const char * map, const uint8_t * lookup) {
+            loadAccess(reinterpret_cast<const uint8_t *>(map), lookup);
+        }
+
+        /// Write the access data of every cell to width * height bytes in row order
+        void exportAccess (uint8_t * access) const;
+
+        /// Set the traversal cost of every cell from width * height bytes in row order
+        void loadCosts (const uint8_t * costs);
+
+        /// Write the traversal cost of every cell to width * height bytes in row order
+        void exportCosts (uint8_t * costs) const;
+
+        Field_t<DimensionType, MaxNavLayer, Storage, Layout> * addPointOfInterest (size_t layer, const PointOfInterests& poi);
+
+        /// Build a layer with the given build mode. Streamed storages only build BREADTH_FIRST layers and throw std::invalid_argument for other modes
+        Field_t<DimensionType, MaxNavLayer, Storage, Layout> * addPointOfInterest (size_t layer, const PointOfInterests& poi, BuildModes::BuildMode_t mode);
+
+        /// Build a layer with the scratch buffers of `workspace` instead of those of the calling thread, e.g. one workspace per job of a job system
+        Field_t<DimensionType, MaxNavLayer, Storage, Layout> * addPointOfInterest (size_t layer, const PointOfInterests& poi, BuildModes::BuildMode_t mode, BuildWorkspace& workspace);
+
+        /// Same as addPointOfInterest, but every BFS level is expanded across the workers of `pool`. Produces the same layer as the serial build. Not available on streamed storages
+        Field_t<DimensionType, MaxNavLayer, Storage, Layout> * addPointOfInterest (size_t layer, const PointOfInterests& poi, ThreadPool& pool);
+
+        /// Start a WEIGHTED build of a layer that continueBuild carries out in slices, e.g. one slice per frame. The layer must not be queried, and `workspace` must not be used by other builds, until continueBuild returns true. Not available on streamed storages
+        void beginBuild (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace);
+
+        /// Take at most `maxCells` cells (0 for no limit) from the queue of the build of `layer` started by beginBuild. Returns true once the layer is built. Throws std::logic_error if no build of the layer is under way in `workspace`
+        bool continueBuild (size_t layer, size_t maxCells, BuildWorkspace& workspace);
+
+        /// Build several layers in one traversal, sharing the access checks of every cell between them. Up to 64 layers are expanded at once. Not available on streamed storages
+        Field_t<DimensionType, MaxNavLayer, Storage, Layout> * addPointOfInterest (const LayerPointOfInterests& layerPoi);
+
+        /// Build several layers in one traversal with the scratch buffers of `workspace`
+        Field_t<DimensionType, MaxNavLayer, Storage, Layout> * addPointOfInterest (const LayerPointOfInterests& layerPoi, BuildWorkspace& workspace);
+
+        /// Repair every built layer after the access data of `changedCells` was modified (e.g. a door was closed)
+        Field_t<DimensionType, MaxNavLayer, Storage, Layout> * updateCells (const std::vector<Vec2>& changedCells);
+
+        /// Repair a single layer after the access data of `changedCells` was modified
+        Field_t<DimensionType, MaxNavLayer, Storage, Layout> * updateCells (size_t layer, const std::vector<Vec2>& changedCells);
 
         /// Get cardinal direction from a coordinate
         Direction_t getDirection (size_t layer, DimensionType x, DimensionType y);
@@ -88,13 +196,66 @@ namespace flow {
         /// Get the next cell's coordinate from a coordinate point
         void getNextCell (size_t layer, DimensionType x, DimensionType y, DimensionType * nX, DimensionType * nY);
 
-        /// Get the next cell's coordinate from a coordinate point
+        /// Get direction vectors for `count` coordinates (x[i], y[i]) at once. Vectorized with AVX2 or SSE4.1 when enabled at compile time
+        void getDirections (size_t layer, size_t count, const DimensionType * x, const DimensionType * y, float * vX, float * vY);
+
+        /// Get direction vectors for `count` coordinates (x[i], y[i]) at once
+        void getDirections (size_t layer, size_t count, const DimensionType * x, const DimensionType * y, double * vX, double * vY);
+
+        /// Get the next cell's coordinate for `count` coordinates at once. nX and nY may point to x and y to update them in place
+        void getNextCells (size_t layer, size_t count, const DimensionType * x, const DimensionType * y, DimensionType * nX, DimensionType * nY);
+
+        /// Direction vector at a position, interpolated from the 4 nearest cells. Cell (x, y) covers [x, x + 1) x [y, y + 1)
+        void sampleDirection (size_t layer, float x, float y, float * vX, float * vY);
+
+        /// Direction vector at a position, interpolated from the 4 nearest cells
+        void sampleDirection (size_t layer, double x, double y, double * vX, double * vY);
+
+        /// Interpolated direction vectors for `count` positions (x[i], y[i]) at once
+        void sampleDirections (size_t layer, size_t count, const float * x, const float * y, float * vX, float * vY);
+
+        /// Interpolated direction vectors for `count` positions (x[i], y[i]) at once
+        void sampleDirections (size_t layer, size_t count, const double * x, const double * y, double * vX, double * vY);
+
+        /// Unit vector of the route at a coordinate. Any angle for EIKONAL layers, the direction vector (diagonals normalized) for other layers. 0 for walls, destinations and cells without a route
+        void getGradient (size_t layer, DimensionType x, DimensionType y, float * vX, float * vY);
+
+        /// Keep the distance of every cell to its point of interest in a plane of 4 bytes per cell. Takes effect from the next build of the layer. Throws std::invalid_argument on streamed storages
+        void keepDistances (size_t layer, bool keep = true);
+
+        /// Distance to the point of interest a coordinate leads to: steps for BREADTH_FIRST layers, BuildModes::stepWeight units for WEIGHTED layers. UNREACHABLE_DISTANCE for walls, cells without a route, and layers that do not keep distances
+        uint32_t getDistance (size_t layer, DimensionType x, DimensionType y);
+
+        /// Whether the latest build or repair of a layer found a route from a coordinate. False for walls and layers never built
+        bool isReached (size_t layer, DimensionType x, DimensionType y);
+
+        /// Get the distances of `count` coordinates at once
+        void getDistances (size_t layer, size_t count, const DimensionType * x, const DimensionType * y, uint32_t * distances);
+
+        /// Statistics of the latest build or repair of a layer. Only collected when compiled with FLOW_BUILD_STATS
+        const BuildStats& buildStats (size_t layer) const {
+            return layers[layer].stats;
+        }
+
+        /// Direction queries of a layer since the last reset. Only counted when compiled with FLOW_QUERY_COUNTERS
+        QueryCounts queryCounts (size_t layer) const {
+            return {layers[layer].directionQueries.load(std::memory_order_relaxed), layers[layer].nextCellQueries.load(std::memory_order_relaxed)};
+        }
+
+        void resetQueryCounts () {
+            for (size_t layer = 0; layer < layerCount(); ++layer) {
+                layers[layer].directionQueries.store(0, std::memory_order_relaxed);
+                layers[layer].nextCellQueries.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        /// Get the cell at a coordinate point
         inline CellType at (DimensionType x, DimensionType y) const {
             return cells[vec2ToArrayIdx(x, y)];
         }
 
-        /// Get the next cell's coordinate from a coordinate point
-        inline CellType& at (DimensionType x, DimensionType y) {
+        /// Get the cell at a coordinate point
+        inline typename Storage::reference at (DimensionType x, DimensionType y) {
             return cells[vec2ToArrayIdx(x, y)];
         }
 
@@ -102,47 +263,100 @@ namespace flow {
         DimensionType width;
         DimensionType height;
 
-        CellType * cells;
+        Layout layout;
+        Storage cells;
 
-    private:
-        size_t vec2ToArrayIdx (DimensionType x, DimensionType y) {
-            const auto col = x;
-            const auto row = y;
-            const auto rowLength = width; // Number of column in a row
+        /// Bookkeeping of the latest build of a layer
+        struct LayerState {
+            bool built;
+            uint8_t buildId;
+            BuildModes::BuildMode_t mode;
+            uint64_t generation; // Number of build IDs issued to the layer
+
+            std::vector<uint32_t> distances; // Empty unless the layer keeps distances
+            std::vector<float> gradients;    // Route vector (x, y) per cell of EIKONAL layers, empty otherwise
 
-            return (row * rowLength) + col;
+            BuildStats stats;
+            std::atomic<uint64_t> directionQueries;
+            std::atomic<uint64_t> nextCellQueries;
+        };
+
+        std::unique_ptr<LayerState[]> layers; // One per storage layer
+
+    private:
+        size_t vec2ToArrayIdx (DimensionType x, DimensionType y) const {
+            return layout.index(x, y);
         }
 
-        size_t vec2ToArrayIdx (Vec2 in) {
+        size_t vec2ToArrayIdx (Vec2 in) const {
             return vec2ToArrayIdx(in[0], in[1]);
         }
 
-        size_t moveIndexByDirection (size_t idx, Direction_t dir) {
-            if (idx == (size_t)-1)
-                return -1;
-
-            switch (dir) {
-                case Directions::NORTH:
-                    return (idx / width > 0 ? idx - width : -1);
-                case Directions::SOUTH:
-                    return (idx / width < (height - 1) ? idx + width : -1);
-                case Directions::EAST:
-                    return (idx % width < (width - 1) ? idx + 1 : -1);
-                case Directions::WEST:
-                    return (idx % width > 0 ? idx - 1 : -1);
-
-                case Directions::NORTH_EAST:
-                    return moveIndexByDirection( moveIndexByDirection(idx, Directions::NORTH), Directions::EAST );
-                case Directions::NORTH_WEST:
-                    return moveIndexByDirection( moveIndexByDirection(idx, Directions::NORTH), Directions::WEST );
-                case Directions::SOUTH_EAST:
-                    return moveIndexByDirection( moveIndexByDirection(idx, Directions::SOUTH), Directions::EAST );
-                case Directions::SOUTH_WEST:
-                    return moveIndexByDirection( moveIndexByDirection(idx, Directions::SOUTH), Directions::WEST );
-
-                default:
-                    return -1;
-            }
+        uint8_t nextBuildId (size_t layer);
+
+        size_t expandNeighbour (size_t layer, uint8_t buildId, size_t cellIdx, Direction_t dir);
+
+        template <typename Index>
+        void buildBreadthFirst (size_t layer, const PointOfInterests& poi, RingQueue<Index>& cellQueue);
+
+        void buildWeighted (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace);
+
+        void buildBitboard (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace);
+
+        void buildEikonal (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace);
+
+        void buildStreamed (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace);
+
+        void repairBreadthFirst (size_t layer, uint8_t buildId, std::vector<std::pair<uint32_t, size_t>>& seeds, std::unordered_map<size_t, uint32_t>& distance);
+
+        void repairWeighted (size_t layer, uint8_t buildId, const std::vector<std::pair<uint32_t, size_t>>& seeds, std::unordered_map<size_t, uint32_t>& distance);
+
+        void finishBuild (size_t layer, uint8_t buildId, BuildModes::BuildMode_t mode) {
+            layers[layer].built = true;
+            layers[layer].buildId = buildId;
+            layers[layer].mode = mode;
+
+            if (mode != BuildModes::EIKONAL)
+                layers[layer].gradients.clear();
+
+            FLOW_STATS(layers[layer].stats.unreachableCells = countUnreachable(layer, buildId));
+        }
+
+        BuildStats& beginStats (size_t layer, BuildModes::BuildMode_t mode, bool repair) {
+            layers[layer].stats = BuildStats();
+            layers[layer].stats.mode = mode;
+            layers[layer].stats.repair = repair;
+            return layers[layer].stats;
+        }
+
+        uint64_t countUnreachable (size_t layer, uint8_t buildId);
+
+        /// Distance plane of a layer, or nullptr if it does not keep distances
+        uint32_t * distancePlane (size_t layer) {
+            return layers[layer].distances.empty() ? nullptr : layers[layer].distances.data();
+        }
+
+        /// Distance plane of a layer reset to UNREACHABLE_DISTANCE for a full build, or nullptr
+        uint32_t * resetDistances (size_t layer);
+
+        /// Call fn(storage index, row order index, count) for runs of cells that are contiguous in both orders
+        template <typename Fn>
+        void forEachRun (std::true_type, Fn fn) const;
+
+        template <typename Fn>
+        void forEachRun (std::false_type, Fn fn) const;
+
+        template <typename F>
+        void sampleAt (const uint8_t * base, size_t stride, F x, F y, F * vX, F * vY) const;
+
+        template <typename Mask>
+        void buildLayers (const std::pair<size_t, PointOfInterests> * group, size_t count, LayerMasks<Mask>& masks);
+
+        template <typename ClaimKey>
+        void expandParallel (size_t layer, uint8_t buildId, const std::vector<size_t>& seeds, ThreadPool& pool);
+
+        size_t moveIndexByDirection (size_t idx, Direction_t dir) const {
+            return layout.neighbour(idx, dir);
         }
     };
 
@@ -150,6 +364,50 @@ namespace flow {
     using LayeredField = Field_t<uint16_t, MaxNavLayer>;
 
     using Field = LayeredField<1>;
+
+    /// Field with 32 bit coordinates, for maps wider or taller than 65535 cells
+    template <size_t MaxNavLayer>
+    using WideLayeredField = Field_t<uint32_t, MaxNavLayer>;
+
+    using WideField = WideLayeredField<1>;
+
+    template <size_t MaxNavLayer>
+    using PlanarLayeredField = Field_t<uint16_t, MaxNavLayer, PlanarCells<MaxNavLayer>>;
+
+    using PlanarField = PlanarLayeredField<1>;
+
+    /// Planar field whose layer count is a constructor argument: PooledField field(width, height, layerCount)
+    using PooledField = Field_t<uint16_t, DYNAMIC_LAYERS, PlanarCells<DYNAMIC_LAYERS>>;
+
+    /// Planar field with a wall border, optionally with compile-time dimensions: PaddedLayeredField<2, 256, 256>
+    template <size_t MaxNavLayer, size_t Width = 0, size_t Height = 0>
+    using PaddedLayeredField = Field_t<uint16_t, MaxNavLayer, PlanarCells<MaxNavLayer>, PaddedLayout<Width, Height>>;
+
+    using PaddedField = PaddedLayeredField<1>;
+
+    /// Planar field stored in TileSize x TileSize tiles: TiledLayeredField<2, 8>
+    template <size_t MaxNavLayer, size_t TileSize = 16>
+    using TiledLayeredField = Field_t<uint16_t, MaxNavLayer, PlanarCells<MaxNavLayer>, TiledLayout<TileSize>>;
+
+    /// Planar field stored in Z-order
+    template <size_t MaxNavLayer>
+    using MortonLayeredField = Field_t<uint16_t, MaxNavLayer, PlanarCells<MaxNavLayer>, MortonLayout>;
+
+    /// Field with 32 bit coordinates whose tiles live in a file, see TileFileCells: StreamedField field(width, height, "/scratch/map.tiles", residentTiles)
+    template <size_t MaxNavLayer, size_t TileSize = 256>
+    using StreamedLayeredField = Field_t<uint32_t, MaxNavLayer, TileFileCells<MaxNavLayer, TileSize>, TiledLayout<TileSize>>;
+
+    using StreamedField = StreamedLayeredField<1>;
 }
 
 #include "field.cpp"
+#include "fieldParallel.cpp"
+#include "fieldMultiLayer.cpp"
+#include "fieldWeighted.cpp"
+#include "fieldBitboard.cpp"
+#include "fieldEikonal.cpp"
+#include "fieldStreamed.cpp"
+#include "fieldRepair.cpp"
+#include "fieldBatch.cpp"
+#include "fieldSample.cpp"
+#include "fieldBulk.cpp"
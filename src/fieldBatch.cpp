@@ -0,0 +1,288 @@
+#include "field.hpp"
+
+#ifndef field_batch_cpp
+#define field_batch_cpp
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include "fieldCell.hpp"
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#define NULL_GUARD(i) if (i == nullptr)\
+                             throw std::runtime_error("NULL pointer exception")
+
+#define VALIDATE_LAYER(layer) if (layer >= layerCount())\
+                                  throw std::range_error("Layer out of range")
+
+namespace flow {
+
+/* SIMD kernels for the batch lookups.
+ *
+ * Each kernel handles as many leading coordinates as it can and returns how
+ * many it processed. The remaining ones go through the scalar loop. Kernels
+ * are selected at compile time (-mavx2 or -msse4.1) for 16 and 32 bit
+ * coordinates; every other combination only uses the scalar loop.
+ *
+ * Direction bytes are loaded 32 bits at a time, which is why the storages
+ * keep at least 3 readable bytes after the last cell's direction byte.
+ *
+ * Kernels index cells as y * width + x from `base`. The caller passes the
+ * layout's row stride as the width and offsets `base` to its origin. Layouts
+ * that are not linear (tiled, Morton) only use the scalar loop.
+ */
+namespace batch {
+    template <typename T>
+    inline size_t directions (const uint8_t *, size_t, size_t, size_t, const T *, const T *, float *, float *) {
+        return 0;
+    }
+
+    template <typename T>
+    inline size_t nextCells (const uint8_t *, size_t, size_t, size_t, const T *, const T *, T *, T *) {
+        return 0;
+    }
+
+#if defined(__AVX2__)
+    inline __m256i loadCoords (const uint16_t * in) {
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)in));
+    }
+
+    inline __m256i loadCoords (const uint32_t * in) {
+        return _mm256_loadu_si256((const __m256i *)in);
+    }
+
+    inline void storeCoords (uint16_t * out, __m256i v) {
+        v = _mm256_and_si256(v, _mm256_set1_epi32(0xFFFF)); // Wrap like the scalar path instead of saturating
+        _mm_storeu_si128((__m128i *)out, _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+    }
+
+    inline void storeCoords (uint32_t * out, __m256i v) {
+        _mm256_storeu_si256((__m256i *)out, v);
+    }
+
+    // Gather 8 direction codes
+    inline __m256i gatherDirections (const uint8_t * base, __m256i x, __m256i y, __m256i width, __m256i stride) {
+        const __m256i offset = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(y, width), x), stride);
+        return _mm256_and_si256(_mm256_i32gather_epi32((const int *)base, offset, 1), _mm256_set1_epi32(0xF));
+    }
+
+    // 16 entry table lookup: permute within each half of the table, then pick the half with bit 3
+    inline __m256 lookup (__m256 low, __m256 high, __m256i dir) {
+        const __m256 useHigh = _mm256_castsi256_ps(_mm256_slli_epi32(dir, 28));
+        return _mm256_blendv_ps(_mm256_permutevar8x32_ps(low, dir), _mm256_permutevar8x32_ps(high, dir), useHigh);
+    }
+
+    template <typename T>
+    inline size_t directionsAvx2 (const uint8_t * base, size_t stride, size_t width, size_t count, const T * x, const T * y, float * vX, float * vY) {
+        const __m256 lowX = _mm256_loadu_ps(Directions::vectorX), highX = _mm256_loadu_ps(Directions::vectorX + 8);
+        const __m256 lowY = _mm256_loadu_ps(Directions::vectorY), highY = _mm256_loadu_ps(Directions::vectorY + 8);
+        const __m256i widthV = _mm256_set1_epi32((int)width), strideV = _mm256_set1_epi32((int)stride);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256i dir = gatherDirections(base, loadCoords(x + i), loadCoords(y + i), widthV, strideV);
+            _mm256_storeu_ps(vX + i, lookup(lowX, highX, dir));
+            _mm256_storeu_ps(vY + i, lookup(lowY, highY, dir));
+        }
+        return i;
+    }
+
+    template <typename T>
+    inline size_t nextCellsAvx2 (const uint8_t * base, size_t stride, size_t width, size_t count, const T * x, const T * y, T * nX, T * nY) {
+        const __m256i lowX = _mm256_loadu_si256((const __m256i *)Directions::stepX), highX = _mm256_loadu_si256((const __m256i *)(Directions::stepX + 8));
+        const __m256i lowY = _mm256_loadu_si256((const __m256i *)Directions::stepY), highY = _mm256_loadu_si256((const __m256i *)(Directions::stepY + 8));
+        const __m256i widthV = _mm256_set1_epi32((int)width), strideV = _mm256_set1_epi32((int)stride);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256i cX = loadCoords(x + i), cY = loadCoords(y + i);
+            const __m256i dir = gatherDirections(base, cX, cY, widthV, strideV);
+            const __m256i sX = _mm256_castps_si256(lookup(_mm256_castsi256_ps(lowX), _mm256_castsi256_ps(highX), dir));
+            const __m256i sY = _mm256_castps_si256(lookup(_mm256_castsi256_ps(lowY), _mm256_castsi256_ps(highY), dir));
+            storeCoords(nX + i, _mm256_add_epi32(cX, sX));
+            storeCoords(nY + i, _mm256_add_epi32(cY, sY));
+        }
+        return i;
+    }
+
+    inline size_t directions (const uint8_t * base, size_t stride, size_t width, size_t count, const uint16_t * x, const uint16_t * y, float * vX, float * vY) {
+        return directionsAvx2(base, stride, width, count, x, y, vX, vY);
+    }
+
+    inline size_t directions (const uint8_t * base, size_t stride, size_t width, size_t count, const uint32_t * x, const uint32_t * y, float * vX, float * vY) {
+        return directionsAvx2(base, stride, width, count, x, y, vX, vY);
+    }
+
+    inline size_t nextCells (const uint8_t * base, size_t stride, size_t width, size_t count, const uint16_t * x, const uint16_t * y, uint16_t * nX, uint16_t * nY) {
+        return nextCellsAvx2(base, stride, width, count, x, y, nX, nY);
+    }
+
+    inline size_t nextCells (const uint8_t * base, size_t stride, size_t width, size_t count, const uint32_t * x, const uint32_t * y, uint32_t * nX, uint32_t * nY) {
+        return nextCellsAvx2(base, stride, width, count, x, y, nX, nY);
+    }
+#elif defined(__SSE4_1__)
+    // No gather below AVX2: direction codes are loaded one by one, the table lookup is vectorized
+    template <typename T>
+    inline __m128i loadDirections (const uint8_t * base, size_t stride, size_t width, const T * x, const T * y) {
+        return _mm_setr_epi32(base[((size_t)y[0] * width + x[0]) * stride] & 0xF,
+                              base[((size_t)y[1] * width + x[1]) * stride] & 0xF,
+                              base[((size_t)y[2] * width + x[2]) * stride] & 0xF,
+                              base[((size_t)y[3] * width + x[3]) * stride] & 0xF);
+    }
+
+    // Table values are multiples of 0.5 in [-1, 1], stored doubled as signed bytes for pshufb
+    inline __m128 lookup (__m128i table, __m128i dir) {
+        const __m128i packed = _mm_shuffle_epi8(table, _mm_packus_epi16(_mm_packus_epi32(dir, dir), _mm_setzero_si128()));
+        return _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi8_epi32(packed)), _mm_set1_ps(0.5f));
+    }
+
+    inline __m128i table (const float * values) {
+        int8_t doubled[16];
+        for (size_t i = 0; i < 16; ++i)
+            doubled[i] = (int8_t)(values[i] * 2);
+        return _mm_loadu_si128((const __m128i *)doubled);
+    }
+
+    template <typename T>
+    inline size_t directionsSse (const uint8_t * base, size_t stride, size_t width, size_t count, const T * x, const T * y, float * vX, float * vY) {
+        const __m128i tableX = table(Directions::vectorX), tableY = table(Directions::vectorY);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128i dir = loadDirections(base, stride, width, x + i, y + i);
+            _mm_storeu_ps(vX + i, lookup(tableX, dir));
+            _mm_storeu_ps(vY + i, lookup(tableY, dir));
+        }
+        return i;
+    }
+
+    inline size_t directions (const uint8_t * base, size_t stride, size_t width, size_t count, const uint16_t * x, const uint16_t * y, float * vX, float * vY) {
+        return directionsSse(base, stride, width, count, x, y, vX, vY);
+    }
+
+    inline size_t directions (const uint8_t * base, size_t stride, size_t width, size_t count, const uint32_t * x, const uint32_t * y, float * vX, float * vY) {
+        return directionsSse(base, stride, width, count, x, y, vX, vY);
+    }
+#endif
+
+    /// Kernel entry points for a layout, selected by whether the layout is linear
+    template <typename Layout, typename T>
+    inline size_t directions (std::true_type, const Layout& layout, const uint8_t * base, size_t stride, size_t count, const T * x, const T * y, float * vX, float * vY) {
+        return directions(base + layout.origin() * stride, stride, layout.rowStride(), count, x, y, vX, vY);
+    }
+
+    template <typename Layout, typename T>
+    inline size_t directions (std::false_type, const Layout&, const uint8_t *, size_t, size_t, const T *, const T *, float *, float *) {
+        return 0;
+    }
+
+    template <typename Layout, typename T>
+    inline size_t nextCells (std::true_type, const Layout& layout, const uint8_t * base, size_t stride, size_t count, const T * x, const T * y, T * nX, T * nY) {
+        return nextCells(base + layout.origin() * stride, stride, layout.rowStride(), count, x, y, nX, nY);
+    }
+
+    template <typename Layout, typename T>
+    inline size_t nextCells (std::false_type, const Layout&, const uint8_t *, size_t, size_t, const T *, const T *, T *, T *) {
+        return 0;
+    }
+}
+
+/// Get direction vectors for `count` coordinates at once
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::getDirections (size_t layer, size_t count, const T * x, const T * y, float * vX, float * vY) {
+    VALIDATE_LAYER(layer);
+    NULL_GUARD(x);
+    NULL_GUARD(y);
+    NULL_GUARD(vX);
+    NULL_GUARD(vY);
+
+    FLOW_COUNT_QUERIES(layers[layer].directionQueries, count);
+
+    const uint8_t * base = cells.directionData(layer);
+    const size_t stride = cells.directionStride();
+
+    // Gather offsets are 32 bit signed
+    size_t i = 0;
+    if (cells.size() * stride < (size_t)INT32_MAX)
+        i = batch::directions(std::integral_constant<bool, G::linear>(), layout, base, stride, count, x, y, vX, vY);
+
+    for (; i < count; ++i) {
+        const auto dir = base[vec2ToArrayIdx(x[i], y[i]) * stride] & 0xF;
+        vX[i] = Directions::vectorX[dir];
+        vY[i] = Directions::vectorY[dir];
+    }
+}
+
+/// Get direction vectors for `count` coordinates at once
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::getDirections (size_t layer, size_t count, const T * x, const T * y, double * vX, double * vY) {
+    VALIDATE_LAYER(layer);
+    NULL_GUARD(x);
+    NULL_GUARD(y);
+    NULL_GUARD(vX);
+    NULL_GUARD(vY);
+
+    FLOW_COUNT_QUERIES(layers[layer].directionQueries, count);
+
+    const uint8_t * base = cells.directionData(layer);
+    const size_t stride = cells.directionStride();
+
+    for (size_t i = 0; i < count; ++i) {
+        const auto dir = base[vec2ToArrayIdx(x[i], y[i]) * stride] & 0xF;
+        vX[i] = Directions::vectorX[dir];
+        vY[i] = Directions::vectorY[dir];
+    }
+}
+
+/// Get the next cell's coordinate for `count` coordinates at once
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::getNextCells (size_t layer, size_t count, const T * x, const T * y, T * nX, T * nY) {
+    VALIDATE_LAYER(layer);
+    NULL_GUARD(x);
+    NULL_GUARD(y);
+    NULL_GUARD(nX);
+    NULL_GUARD(nY);
+
+    FLOW_COUNT_QUERIES(layers[layer].nextCellQueries, count);
+
+    const uint8_t * base = cells.directionData(layer);
+    const size_t stride = cells.directionStride();
+
+    size_t i = 0;
+    if (cells.size() * stride < (size_t)INT32_MAX)
+        i = batch::nextCells(std::integral_constant<bool, G::linear>(), layout, base, stride, count, x, y, nX, nY);
+
+    for (; i < count; ++i) {
+        const auto dir = base[vec2ToArrayIdx(x[i], y[i]) * stride] & 0xF;
+        nX[i] = x[i] + Directions::stepX[dir];
+        nY[i] = y[i] + Directions::stepY[dir];
+    }
+}
+
+/// Get the distances to the point of interest for `count` coordinates at once
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::getDistances (size_t layer, size_t count, const T * x, const T * y, uint32_t * distances) {
+    VALIDATE_LAYER(layer);
+    NULL_GUARD(x);
+    NULL_GUARD(y);
+    NULL_GUARD(distances);
+
+    const uint32_t * distance = distancePlane(layer);
+    if (distance == nullptr) {
+        std::fill(distances, distances + count, UNREACHABLE_DISTANCE);
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        distances[i] = distance[vec2ToArrayIdx(x[i], y[i])];
+}
+
+} // namespace flow
+
+#undef VALIDATE_LAYER
+#undef NULL_GUARD
+
+#endif // field_batch_cpp
@@ -0,0 +1,339 @@
+#include "field.hpp"
+
+#ifndef field_bitboard_cpp
+#define field_bitboard_cpp
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include "fieldCell.hpp"
+
+namespace flow {
+
+/* Bitboards of 8x8 cell tiles.
+ *
+ * Bit (row * 8 + column) of a 64 bit word holds the cell at that position of
+ * its tile. Tiles are stored in row major order, inside a border of empty
+ * tiles.
+ */
+namespace bitboard {
+    static const uint64_t FIRST_COLUMN = 0x0101010101010101ULL;
+    static const uint64_t LAST_COLUMN  = 0x8080808080808080ULL;
+    static const uint64_t FIRST_ROW    = 0x00000000000000FFULL;
+    static const uint64_t LAST_ROW     = 0xFF00000000000000ULL;
+
+    inline size_t lowestBit (uint64_t tile) {
+#if defined(__GNUC__)
+        return (size_t)__builtin_ctzll(tile);
+#else
+        size_t bit = 0;
+        while (((tile >> bit) & 1) == 0)
+            ++bit;
+        return bit;
+#endif
+    }
+
+    inline uint64_t bitCount (uint64_t tile) {
+#if defined(__GNUC__)
+        return (uint64_t)__builtin_popcountll(tile);
+#else
+        uint64_t count = 0;
+        for (; tile != 0; tile &= tile - 1)
+            ++count;
+        return count;
+#endif
+    }
+
+    /// Bit `bit` of 8 bytes, packed into the low byte (byte i to bit i)
+    inline uint64_t gather (uint64_t bytes, size_t bit) {
+        return (((bytes >> bit) & FIRST_COLUMN) * 0x0102040810204080ULL) >> 56;
+    }
+
+    /// Cells of the tile on the side of `dx` (-1, 0 or 1) and `dy`: a column, a row, a corner, or the whole tile for 0, 0
+    inline uint64_t edge (int32_t dx, int32_t dy) {
+        uint64_t cells = ~(uint64_t)0;
+        if (dx != 0)
+            cells &= dx < 0 ? FIRST_COLUMN : LAST_COLUMN;
+        if (dy != 0)
+            cells &= dy < 0 ? FIRST_ROW : LAST_ROW;
+        return cells;
+    }
+
+    /// Move the bits so that each cell holds the bit of the cell dy rows away, taken from `vertical` past the tile edge
+    inline uint64_t shiftRows (uint64_t tile, uint64_t vertical, int32_t dy) {
+        if (dy > 0)
+            return (tile >> 8) | (vertical << 56);
+        if (dy < 0)
+            return (tile << 8) | (vertical >> 56);
+        return tile;
+    }
+
+    /// Move the bits so that each cell holds the bit of the cell at (+dx, +dy). `side`, `vertical` and `corner` are the tiles towards dx, dy and both
+    inline uint64_t shifted (uint64_t tile, uint64_t side, uint64_t vertical, uint64_t corner, int32_t dx, int32_t dy) {
+        const uint64_t column = shiftRows(tile, vertical, dy);
+        if (dx > 0)
+            return ((column >> 1) & ~LAST_COLUMN) | ((shiftRows(side, corner, dy) << 7) & LAST_COLUMN);
+        if (dx < 0)
+            return ((column << 1) & ~FIRST_COLUMN) | ((shiftRows(side, corner, dy) >> 7) & FIRST_COLUMN);
+        return column;
+    }
+}
+
+/* Bitboard build.
+ *
+ * The access data is packed into bitboards: one board per entry direction
+ * (N, E, S, W), passable cells and diagonal access. The frontier and the
+ * reached cells are bitboards too.
+ *
+ * A cell joins the next wave with direction D if it is passable and not
+ * reached yet, the cell one step towards D is in the frontier and can be
+ * entered from D (all the bits of D are in its entry directions), and, for a
+ * diagonal D, it allows diagonal access. These are the checks of the queue
+ * build, done for a whole tile with a few shifts and ANDs per direction.
+ * Only the tiles around the frontier are visited, so a wave costs time in
+ * proportion to its length. Square tiles hold about 8 cells of a straight
+ * front whatever its orientation, where rows of 64 cells would hold a
+ * single cell of a vertical front.
+ *
+ * Waves are the BFS levels, so distances and reachability match the queue
+ * build. A cell reachable from several frontier cells takes the first
+ * direction of Directions::expansionOrder that reaches it, where the queue
+ * build takes the first frontier cell in queue order, so directions may
+ * differ where two routes are equally short. Walls next to a reached cell
+ * are marked like the queue build does, except the border of PaddedLayout,
+ * which is outside the map.
+ */
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::buildBitboard (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace) {
+    FLOW_TRACE_EVENT(BUILD_BEGIN, layer);
+    FLOW_STATS(StatsTimer timer);
+    FLOW_STATS(BuildStats& stats = beginStats(layer, BuildModes::BITBOARD, false));
+
+    const uint8_t buildId = nextBuildId(layer);
+    uint32_t * distance = resetDistances(layer);
+
+    // Tiles are surrounded by a border of empty tiles, so the tiles around a map tile always exist
+    const int32_t tilesX = ((int32_t)width + 7) / 8;
+    const int32_t tilesY = ((int32_t)height + 7) / 8;
+    const ptrdiff_t stride = tilesX + 2;
+    const size_t tileCount = (size_t)stride * (tilesY + 2);
+
+    auto tileAt = [&](size_t tx, size_t ty) {
+        return (ty + 1) * stride + tx + 1;
+    };
+
+    auto cellOf = [&](size_t tile, size_t bit) {
+        return vec2ToArrayIdx((T)((tile % stride - 1) * 8 + bit % 8), (T)((tile / stride - 1) * 8 + bit / 8));
+    };
+
+    auto& access = workspace.accessBoards;
+    auto& reached = workspace.reachedBoards;
+    auto& frontier = workspace.frontierBoards;
+    auto& next = workspace.nextBoards;
+    access.assign(tileCount, AccessBoard());
+    reached.assign(tileCount, 0);
+    frontier.assign(tileCount, 0);
+    next.assign(tileCount, 0);
+
+    // The access bytes are read in row order a band of 8 rows at a time, and packed 8 cells at a time
+    auto& band = workspace.access;
+    band.resize((size_t)width * 8);
+    size_t bandStart = 0; // Row order index of the first cell of the band
+
+    auto packBand = [&]() {
+        const size_t ty = bandStart / band.size();
+        const size_t rows = std::min<size_t>(8, height - ty * 8);
+
+        for (size_t row = 0; row < rows; ++row) {
+            for (size_t tx = 0; tx < (size_t)tilesX; ++tx) {
+                uint64_t bytes = 0;
+                for (size_t i = 0; i < 8 && tx * 8 + i < width; ++i)
+                    bytes |= (uint64_t)band[row * width + tx * 8 + i] << (8 * i);
+
+                auto& tile = access[tileAt(tx, ty)];
+                const size_t shift = row * 8;
+                uint64_t passable = 0;
+                for (size_t k = 0; k < 4; ++k) {
+                    const uint64_t bits = bitboard::gather(bytes, k);
+                    tile.entry[k] |= bits << shift;
+                    passable |= bits;
+                }
+
+                tile.passable |= passable << shift;
+                tile.diagonal |= (bitboard::gather(bytes, 4) & passable) << shift;
+            }
+        }
+    };
+
+    forEachRun(std::integral_constant<bool, G::linear>(), [&](size_t first, size_t source, size_t count) {
+        while (count > 0) {
+            const size_t chunk = std::min(count, bandStart + band.size() - source);
+            cells.readAccess(first, chunk, &band[source - bandStart]);
+            first += chunk;
+            source += chunk;
+            count -= chunk;
+
+            if (source == bandStart + band.size()) {
+                packBand();
+                bandStart = source;
+            }
+        }
+    });
+
+    if (bandStart < (size_t)width * height)
+        packBand();
+
+    auto& active = workspace.activeTiles;
+    auto& nextActive = workspace.nextActiveTiles;
+    auto& candidates = workspace.candidateTiles;
+    auto& visited = workspace.tileVisits; // Wave that last listed a tile as candidate
+    active.clear();
+    nextActive.clear();
+    visited.assign(tileCount, 0);
+
+    // Load POIs to the frontier and mark them as the destination
+    for (auto point : poi) {
+        const auto cellIdx = vec2ToArrayIdx(point);
+        cells[cellIdx].setDirection(layer, Directions::DEST);
+        cells[cellIdx].setBuildId(layer, buildId);
+
+        if (distance != nullptr)
+            distance[cellIdx] = 0;
+
+        const size_t tile = tileAt(point[0] / 8, point[1] / 8);
+        const uint64_t bit = (uint64_t)1 << ((point[1] % 8) * 8 + point[0] % 8);
+        if (frontier[tile] == 0)
+            active.push_back(tile);
+
+        frontier[tile] |= bit;
+        reached[tile] |= bit;
+    }
+
+    FLOW_STATS(stats.cellsEnqueued = stats.peakQueueDepth = poi.size(); stats.seedMs = timer.lapMs());
+    FLOW_TRACE_EVENT(SEED_END, layer);
+
+    const Direction_t * directions = Directions::expansionOrder;
+
+    for (uint32_t level = 1; !active.empty(); ++level) {
+        // Cells of the next wave are in the frontier tiles, or past the tile edges the frontier touches
+        candidates.clear();
+        for (auto tile : active) {
+            for (int32_t dy = -1; dy <= 1; ++dy) {
+                for (int32_t dx = -1; dx <= 1; ++dx) {
+                    const size_t candidate = tile + dy * stride + dx;
+                    if ((frontier[tile] & bitboard::edge(dx, dy)) != 0 && visited[candidate] != level) {
+                        visited[candidate] = level;
+                        candidates.push_back(candidate);
+                    }
+                }
+            }
+        }
+
+        FLOW_STATS(uint64_t waveCells = 0);
+
+        for (auto tile : candidates) {
+            uint64_t open = access[tile].passable & ~reached[tile];
+            if (open == 0)
+                continue;
+
+            uint64_t wave = 0;
+
+            for (auto i = 0; directions[i] != Directions::STOP && open != 0; ++i) {
+                const Direction_t dir = directions[i];
+                const int32_t dx = Directions::stepX[dir];
+                const int32_t dy = Directions::stepY[dir];
+
+                // Frontier cells of the tile at (ox, oy) which can be entered from `dir`
+                auto enterable = [&](int32_t ox, int32_t oy) {
+                    const size_t parent = tile + oy * stride + ox;
+                    uint64_t bits = frontier[parent];
+                    if (bits == 0)
+                        return bits;
+
+                    for (size_t k = 0; k < 4; ++k)
+                        bits &= (dir >> k) & 1 ? access[parent].entry[k] : ~(uint64_t)0;
+                    return bits;
+                };
+
+                // Parents can only lie in this tile and the tiles towards `dir`
+                const uint64_t parents = bitboard::shifted(enterable(0, 0), enterable(dx, 0), enterable(0, dy), enterable(dx, dy), dx, dy);
+
+                uint64_t owned = parents & open;
+                if (Directions::isDiagonal(dir))
+                    owned &= access[tile].diagonal;
+
+                if (owned == 0)
+                    continue;
+
+                open &= ~owned;
+                wave |= owned;
+
+                for (uint64_t bits = owned; bits != 0; bits &= bits - 1) {
+                    const auto cellIdx = cellOf(tile, bitboard::lowestBit(bits));
+                    cells[cellIdx].setBuildId(layer, buildId);
+                    cells[cellIdx].setDirection(layer, dir);
+
+                    if (distance != nullptr)
+                        distance[cellIdx] = level;
+                }
+            }
+
+            if (wave != 0) {
+                reached[tile] |= wave;
+                next[tile] = wave;
+                nextActive.push_back(tile);
+                FLOW_STATS(waveCells += bitboard::bitCount(wave));
+            }
+        }
+
+        // Every cell queued so far has now been expanded
+        FLOW_STATS(stats.cellsVisited = stats.cellsEnqueued);
+        FLOW_STATS(stats.cellsEnqueued += waveCells; stats.peakQueueDepth = std::max(stats.peakQueueDepth, waveCells));
+
+        for (auto tile : active)
+            frontier[tile] = 0;
+
+        frontier.swap(next);
+        active.swap(nextActive);
+        nextActive.clear();
+    }
+
+    // Walls next to a reached cell
+    for (size_t ty = 0; ty < (size_t)tilesY; ++ty) {
+        for (size_t tx = 0; tx < (size_t)tilesX; ++tx) {
+            const size_t tile = tileAt(tx, ty);
+
+            uint64_t around = 0;
+            for (auto i = 0; directions[i] != Directions::STOP; ++i) {
+                const int32_t dx = Directions::stepX[directions[i]];
+                const int32_t dy = Directions::stepY[directions[i]];
+                around |= bitboard::shifted(reached[tile], reached[tile + dx], reached[tile + dy * stride], reached[tile + dy * stride + dx], dx, dy);
+            }
+
+            uint64_t walls = around & ~access[tile].passable & ~reached[tile];
+
+            // Bits past the right and bottom edges of the map are not cells
+            for (size_t column = std::min<size_t>(width - tx * 8, 8); column < 8; ++column)
+                walls &= ~(bitboard::FIRST_COLUMN << column);
+            for (size_t row = std::min<size_t>(height - ty * 8, 8); row < 8; ++row)
+                walls &= ~(bitboard::FIRST_ROW << (row * 8));
+
+            for (; walls != 0; walls &= walls - 1) {
+                const auto cellIdx = cellOf(tile, bitboard::lowestBit(walls));
+                cells[cellIdx].setBuildId(layer, buildId);
+                cells[cellIdx].markDirAsWall(layer);
+                FLOW_STATS(++stats.wallsMarked);
+            }
+        }
+    }
+
+    FLOW_STATS(stats.expandMs = timer.lapMs());
+    finishBuild(layer, buildId, BuildModes::BREADTH_FIRST);
+    FLOW_STATS(stats.totalMs = timer.totalMs());
+    FLOW_TRACE_EVENT(BUILD_END, layer);
+}
+
+} // namespace flow
+
+#endif // field_bitboard_cpp
@@ -0,0 +1,105 @@
+#include "field.hpp"
+
+#ifndef field_bulk_cpp
+#define field_bulk_cpp
+
+#include <stdexcept>
+#include <type_traits>
+#include "fieldCell.hpp"
+
+#define NULL_GUARD(i) if (i == nullptr)\
+                             throw std::runtime_error("NULL pointer exception")
+
+namespace flow {
+
+/* Bulk loads and exports.
+ *
+ * Buffers hold one byte per cell in row order (y * width + x), whatever the
+ * layout. They are copied in runs of cells that are contiguous in both the
+ * buffer and the storage: a single run for the default layout, one run per
+ * row for the other linear layouts, and runs found cell by cell otherwise.
+ * The storage copies a run with one tight loop over its planes (or cells).
+ */
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::loadAccess (const uint8_t * access) {
+    NULL_GUARD(access);
+
+    forEachRun(std::integral_constant<bool, G::linear>(), [&](size_t first, size_t source, size_t count) {
+        cells.writeAccess(first, count, access + source, nullptr);
+    });
+}
+
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::loadAccess (const uint8_t * map, const uint8_t * lookup) {
+    NULL_GUARD(map);
+    NULL_GUARD(lookup);
+
+    forEachRun(std::integral_constant<bool, G::linear>(), [&](size_t first, size_t source, size_t count) {
+        cells.writeAccess(first, count, map + source, lookup);
+    });
+}
+
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::exportAccess (uint8_t * access) const {
+    NULL_GUARD(access);
+
+    forEachRun(std::integral_constant<bool, G::linear>(), [&](size_t first, size_t source, size_t count) {
+        cells.readAccess(first, count, access + source);
+    });
+}
+
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::loadCosts (const uint8_t * costs) {
+    NULL_GUARD(costs);
+
+    forEachRun(std::integral_constant<bool, G::linear>(), [&](size_t first, size_t source, size_t count) {
+        cells.writeCosts(first, count, costs + source);
+    });
+}
+
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::exportCosts (uint8_t * costs) const {
+    NULL_GUARD(costs);
+
+    forEachRun(std::integral_constant<bool, G::linear>(), [&](size_t first, size_t source, size_t count) {
+        cells.readCosts(first, count, costs + source);
+    });
+}
+
+/// Runs of a linear layout: whole rows, merged while the rows follow each other in the storage
+template <typename T, size_t S, typename C, typename G>
+template <typename Fn>
+void Field_t<T, S, C, G>::forEachRun (std::true_type, Fn fn) const {
+    const size_t rowCells = width;
+    const size_t rows = height;
+    if (rowCells == 0 || rows == 0)
+        return;
+
+    const size_t rowsPerRun = layout.rowStride() == rowCells ? rows : 1;
+    for (size_t y = 0; y < rows; y += rowsPerRun)
+        fn(layout.index(0, y), y * rowCells, rowCells * rowsPerRun);
+}
+
+/// Runs of any other layout, found by following the storage index along each row
+template <typename T, size_t S, typename C, typename G>
+template <typename Fn>
+void Field_t<T, S, C, G>::forEachRun (std::false_type, Fn fn) const {
+    for (size_t y = 0; y < height; ++y) {
+        size_t x = 0;
+        while (x < width) {
+            const size_t first = layout.index(x, y);
+            size_t count = 1;
+            while (x + count < width && layout.index(x + count, y) == first + count)
+                ++count;
+
+            fn(first, y * width + x, count);
+            x += count;
+        }
+    }
+}
+
+} // namespace flow
+
+#undef NULL_GUARD
+
+#endif // field_bulk_cpp
@@ -5,28 +5,26 @@
 #include <bitset>
 
 #include "directions.hpp"
+#include "cellArray.hpp"
 #include "field.hpp"
 
 namespace flow {
     template <size_t maxNavLayer>
     class FieldCell {
-        template <typename T, size_t S>
+        template <typename T, size_t S, typename C, typename G>
         friend class Field_t;
 
+        template <size_t L, typename A>
+        friend class CellArray;
+
     public:
         FieldCell () :
             cellData({0}),
-            usedDirectionLayer(0)
+            usedDirectionLayer(0),
+            directions(),
+            traversalCost(1)
         {}
 
-        static uint8_t newBuildId () {
-            uint8_t curBuildId = globalBuildId & 0xF;
-
-            globalBuildId = (++curBuildId) & 0xF;
-
-            return curBuildId;
-        }
-
         size_t getMaxNavLayer () {
             return maxNavLayer;
         }
@@ -53,10 +51,19 @@ namespace flow {
             return getEntryDir() == Directions::WALL;
         }
 
+        /// Cost of moving out of this cell, used by the weighted build mode. 1 (default) to 255
+        void setCost (uint8_t cost) {
+            traversalCost = cost;
+        }
+
+        uint8_t getCost () {
+            return traversalCost;
+        }
+
     private:
-        static uint8_t globalBuildId;
         size_t usedDirectionLayer;
         Direction_t directions[maxNavLayer];
+        uint8_t traversalCost;
 
         union {
             struct {
@@ -0,0 +1,339 @@
+#include "field.hpp"
+
+#ifndef field_eikonal_cpp
+#define field_eikonal_cpp
+
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include "fieldCell.hpp"
+
+namespace flow {
+
+/* Eikonal build (fast sweeping method).
+ *
+ * Solves |grad T| = cost for the arrival time T of every cell, with T = 0 at
+ * the points of interest. A cell is updated from its upwind neighbours with
+ * the Godunov scheme: from its cheaper horizontal and vertical neighbour
+ * together, which lets the front travel at any angle, or along a single
+ * diagonal. Cells are swept in the four orders of (x, y) increasing or
+ * decreasing until no arrival time improves.
+ *
+ * Sweeping from infinity, each turn of a route around an obstacle would cost
+ * another round of sweeps. The sweeps rather start from a first guess made
+ * with the same update, solving the cells in order of arrival time with a
+ * heap (fast marching). The guess is never below the solution and usually
+ * already is the solution, and a cell is only updated again once one of its
+ * neighbours has improved, so the sweeps mostly confirm it.
+ *
+ * A neighbour is only upwind of a cell if the BFS build would let the cell
+ * point to it: the neighbour must be enterable from that side (entry
+ * directions, so walls are never upwind), and a diagonal also needs diagonal
+ * access on the cell. The sweeps work on row order copies of the access
+ * bytes and costs, whatever the storage and layout.
+ *
+ * The gradient of a cell is -grad T from its upwind neighbours, normalized.
+ * Its direction is the allowed step to a neighbour with a smaller arrival time
+ * that is closest to the gradient, so following directions still ends at a
+ * point of interest. Distances are kept in BuildModes::stepWeight units, like
+ * those of WEIGHTED layers. Cells of cost 0 cost 1.
+ */
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::buildEikonal (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace) {
+    FLOW_TRACE_EVENT(BUILD_BEGIN, layer);
+    FLOW_STATS(StatsTimer timer);
+    FLOW_STATS(BuildStats& stats = beginStats(layer, BuildModes::EIKONAL, false));
+
+    const uint8_t buildId = nextBuildId(layer);
+    uint32_t * distance = resetDistances(layer);
+
+    const size_t w = width;
+    const size_t h = height;
+    const float unreached = std::numeric_limits<float>::infinity();
+    const float diagonalStep = 1.41421356f;
+
+    auto& access = workspace.access;
+    auto& costs = workspace.costs;
+    auto& time = workspace.arrivalTimes;
+    access.resize(w * h);
+    costs.resize(w * h);
+    time.assign(w * h, unreached);
+
+    forEachRun(std::integral_constant<bool, G::linear>(), [&](size_t first, size_t source, size_t count) {
+        cells.readAccess(first, count, &access[source]);
+        cells.readCosts(first, count, &costs[source]);
+    });
+
+    // Points of interest keep their arrival time of 0
+    auto& fixed = workspace.fixed;
+    fixed.assign(w * h, 0);
+
+    for (auto point : poi) {
+        const size_t i = (size_t)point[1] * w + point[0];
+        time[i] = 0;
+        fixed[i] = 1;
+
+        const auto cellIdx = vec2ToArrayIdx(point);
+        cells[cellIdx].setDirection(layer, Directions::DEST);
+        cells[cellIdx].setBuildId(layer, buildId);
+    }
+
+    // The neighbour of cell i towards dir is upwind if it can be entered moving in dir
+    auto enterable = [&](size_t i, Direction_t dir) {
+        return (access[i] & dir) == dir;
+    };
+
+    // Arrival time of a passable cell from its upwind neighbours
+    auto solve = [&](size_t x, size_t y) -> float {
+        const size_t i = y * w + x;
+        const float cost = (float)std::max<uint8_t>(costs[i], 1);
+
+        float a = unreached, b = unreached;
+        if (x > 0 && enterable(i - 1, Directions::WEST))
+            a = time[i - 1];
+        if (x + 1 < w && enterable(i + 1, Directions::EAST))
+            a = std::min(a, time[i + 1]);
+        if (y > 0 && enterable(i - w, Directions::NORTH))
+            b = time[i - w];
+        if (y + 1 < h && enterable(i + w, Directions::SOUTH))
+            b = std::min(b, time[i + w]);
+
+        float t;
+        if (std::fabs(a - b) >= cost || a == unreached || b == unreached)
+            t = std::min(a, b) + cost;
+        else
+            t = (a + b + std::sqrt(2 * cost * cost - (a - b) * (a - b))) / 2;
+
+        if (access[i] & 0x10) {
+            const bool north = y > 0, south = y + 1 < h, west = x > 0, east = x + 1 < w;
+            if (north && west && enterable(i - w - 1, Directions::NORTH_WEST))
+                t = std::min(t, time[i - w - 1] + cost * diagonalStep);
+            if (north && east && enterable(i - w + 1, Directions::NORTH_EAST))
+                t = std::min(t, time[i - w + 1] + cost * diagonalStep);
+            if (south && east && enterable(i + w + 1, Directions::SOUTH_EAST))
+                t = std::min(t, time[i + w + 1] + cost * diagonalStep);
+            if (south && west && enterable(i + w - 1, Directions::SOUTH_WEST))
+                t = std::min(t, time[i + w - 1] + cost * diagonalStep);
+        }
+
+        return t;
+    };
+
+    const Direction_t * directions = Directions::expansionOrder;
+
+    // Initial guess: cells solved in order of arrival time from the neighbours solved so far (fast marching)
+    auto& heap = workspace.arrivalHeap;
+    heap.clear();
+    for (auto point : poi)
+        heap.push_back(std::make_pair(0.0f, (size_t)point[1] * w + point[0]));
+
+    auto later = [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) {
+        return a.first > b.first;
+    };
+
+    FLOW_STATS(stats.cellsEnqueued = stats.peakQueueDepth = poi.size(); stats.seedMs = timer.lapMs());
+    FLOW_TRACE_EVENT(SEED_END, layer);
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        const float current = heap.back().first;
+        const size_t i = heap.back().second;
+        heap.pop_back();
+
+        if (current > time[i])
+            continue;
+
+        FLOW_STATS(++stats.cellsVisited);
+
+        const size_t x = i % w, y = i / w;
+        for (auto d = 0; directions[d] != Directions::STOP; ++d) {
+            // Neighbour n would step to cell i in direction dir
+            const Direction_t dir = Directions::negateDir(directions[d]);
+            const int64_t nX = (int64_t)x + Directions::stepX[directions[d]];
+            const int64_t nY = (int64_t)y + Directions::stepY[directions[d]];
+            if (nX < 0 || nY < 0 || nX >= (int64_t)w || nY >= (int64_t)h || !enterable(i, dir))
+                continue;
+
+            // Cells solved before this one are not improved by it
+            const size_t n = (size_t)nY * w + (size_t)nX;
+            if (time[n] <= current || (access[n] & 0xF) == 0 || (Directions::isDiagonal(dir) && !(access[n] & 0x10)))
+                continue;
+
+            const float t = solve((size_t)nX, (size_t)nY);
+            if (!(t < time[n]))
+                continue;
+
+            time[n] = t;
+            heap.push_back(std::make_pair(t, n));
+            std::push_heap(heap.begin(), heap.end(), later);
+            FLOW_STATS(stats.peakQueueDepth = std::max<uint64_t>(stats.peakQueueDepth, heap.size()));
+        }
+    }
+
+    // Cells are only updated again once a neighbour has improved
+    auto& active = workspace.active;
+    active.assign(w * h, 1);
+
+    auto update = [&](size_t x, size_t y) -> bool {
+        const size_t i = y * w + x;
+        if (!active[i])
+            return false;
+
+        active[i] = 0;
+        FLOW_STATS(++stats.cellsVisited);
+        if (fixed[i] || (access[i] & 0xF) == 0)
+            return false;
+
+        // Improvements below float noise would keep the sweeps going
+        const float t = solve(x, y);
+        if (!(t < time[i] * (1 - 1e-6f)))
+            return false;
+
+        time[i] = t;
+
+        const size_t x0 = x > 0 ? x - 1 : x, x1 = x + 1 < w ? x + 1 : x;
+        const size_t y0 = y > 0 ? y - 1 : y, y1 = y + 1 < h ? y + 1 : y;
+        for (size_t nY = y0; nY <= y1; ++nY)
+            std::fill(&active[nY * w + x0], &active[nY * w + x1] + 1, 1);
+
+        return true;
+    };
+
+    for (bool changed = w * h > 0; changed; ) {
+        changed = false;
+
+        for (size_t sweep = 0; sweep < 4; ++sweep) {
+            const bool backwardX = sweep & 1;
+            const bool backwardY = sweep & 2;
+
+            for (size_t row = 0; row < h; ++row) {
+                const size_t y = backwardY ? h - 1 - row : row;
+                for (size_t column = 0; column < w; ++column)
+                    changed |= update(backwardX ? w - 1 - column : column, y);
+            }
+
+        }
+    }
+
+    // Directions, gradients and distances of the reached cells, and the walls next to them
+    auto& gradients = layers[layer].gradients;
+    gradients.assign(cells.size() * 2, 0.0f);
+
+    for (size_t y = 0; y < h; ++y) {
+        for (size_t x = 0; x < w; ++x) {
+            const size_t i = y * w + x;
+            const auto cellIdx = vec2ToArrayIdx((T)x, (T)y);
+
+            if (fixed[i]) {
+                if (distance != nullptr)
+                    distance[cellIdx] = 0;
+                continue;
+            }
+
+            if ((access[i] & 0xF) == 0) {
+                for (auto d = 0; directions[d] != Directions::STOP; ++d) {
+                    const int64_t nX = (int64_t)x + Directions::stepX[directions[d]];
+                    const int64_t nY = (int64_t)y + Directions::stepY[directions[d]];
+                    if (nX >= 0 && nY >= 0 && nX < (int64_t)w && nY < (int64_t)h && time[(size_t)nY * w + (size_t)nX] != unreached) {
+                        cells[cellIdx].setBuildId(layer, buildId);
+                        cells[cellIdx].markDirAsWall(layer);
+                        FLOW_STATS(++stats.wallsMarked);
+                        break;
+                    }
+                }
+                continue;
+            }
+
+            if (time[i] == unreached)
+                continue;
+
+            if (distance != nullptr)
+                distance[cellIdx] = (uint32_t)std::lround(time[i] * BuildModes::CARDINAL_WEIGHT);
+
+            FLOW_STATS(++stats.cellsEnqueued);
+
+            // -grad T from the upwind neighbours on each axis
+            float gX = 0, gY = 0;
+            if (x > 0 && enterable(i - 1, Directions::WEST) && time[i - 1] < time[i])
+                gX = -(time[i] - time[i - 1]);
+            if (x + 1 < w && enterable(i + 1, Directions::EAST) && time[i + 1] < time[i] && time[i] - time[i + 1] > -gX)
+                gX = time[i] - time[i + 1];
+            if (y > 0 && enterable(i - w, Directions::NORTH) && time[i - w] < time[i])
+                gY = -(time[i] - time[i - w]);
+            if (y + 1 < h && enterable(i + w, Directions::SOUTH) && time[i + w] < time[i] && time[i] - time[i + w] > -gY)
+                gY = time[i] - time[i + w];
+
+            // The allowed step with a smaller arrival time closest to the gradient
+            Direction_t best = Directions::STOP;
+            float bestScore = -unreached;
+            for (auto d = 0; directions[d] != Directions::STOP; ++d) {
+                const Direction_t dir = directions[d];
+                const int64_t nX = (int64_t)x + Directions::stepX[dir];
+                const int64_t nY = (int64_t)y + Directions::stepY[dir];
+                if (nX < 0 || nY < 0 || nX >= (int64_t)w || nY >= (int64_t)h)
+                    continue;
+
+                const size_t n = (size_t)nY * w + (size_t)nX;
+                if (!(time[n] < time[i]) || !enterable(n, dir))
+                    continue;
+
+                const bool diagonal = Directions::isDiagonal(dir);
+                if (diagonal && !(access[i] & 0x10))
+                    continue;
+
+                const float length = diagonal ? diagonalStep : 1.0f;
+                const float score = (gX != 0 || gY != 0) ? (Directions::stepX[dir] * gX + Directions::stepY[dir] * gY) / length : time[i] - time[n];
+                if (score > bestScore) {
+                    best = dir;
+                    bestScore = score;
+                }
+            }
+
+            cells[cellIdx].setBuildId(layer, buildId);
+            cells[cellIdx].setDirection(layer, best);
+
+            // Cells only reached along a diagonal have no axis gradient, they follow their direction
+            if (gX == 0 && gY == 0) {
+                gX = (float)Directions::stepX[best];
+                gY = (float)Directions::stepY[best];
+            }
+
+            const float length = std::sqrt(gX * gX + gY * gY);
+            gradients[cellIdx * 2] = gX / length;
+            gradients[cellIdx * 2 + 1] = gY / length;
+        }
+    }
+
+    FLOW_STATS(stats.expandMs = timer.lapMs());
+    finishBuild(layer, buildId, BuildModes::EIKONAL);
+    FLOW_STATS(stats.totalMs = timer.totalMs());
+    FLOW_TRACE_EVENT(BUILD_END, layer);
+}
+
+/// Get the unit route vector at a coordinate
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::getGradient (size_t layer, T x, T y, float * vX, float * vY) {
+    if (vX == nullptr || vY == nullptr)
+        throw std::runtime_error("NULL pointer exception");
+
+    const auto cellIdx = vec2ToArrayIdx(x, y);
+    const auto& gradients = layers[layer].gradients;
+
+    if (!gradients.empty() && (gradients[cellIdx * 2] != 0 || gradients[cellIdx * 2 + 1] != 0)) {
+        (*vX) = gradients[cellIdx * 2];
+        (*vY) = gradients[cellIdx * 2 + 1];
+        return;
+    }
+
+    const auto dir = getDirection(layer, x, y);
+    const float length = Directions::isDiagonal(dir) ? 1.41421356f : 1.0f;
+    (*vX) = Directions::stepX[dir] / length;
+    (*vY) = Directions::stepY[dir] / length;
+}
+
+} // namespace flow
+
+#endif // field_eikonal_cpp
@@ -0,0 +1,203 @@
+#include "fieldFile.hpp"
+
+#ifndef field_file_cpp
+#define field_file_cpp
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace flow {
+
+namespace FieldFile {
+    // Planar storages are copied plane by plane, other storages cell by cell
+    template <size_t L>
+    inline const uint8_t * rawPlanes (const PlanarCells<L>& cells) {
+        return cells.planeData();
+    }
+
+    template <typename C>
+    inline const uint8_t * rawPlanes (const C&) {
+        return nullptr;
+    }
+
+    static const size_t CHUNK_SIZE = 1 << 16;
+}
+
+template <typename T, size_t L, typename C>
+FieldWriter<T, L, C>::FieldWriter (Field_t<T, L, C>& _field) :
+    field(_field),
+    planeOffset(FieldFile::planeOffset(_field.layerCount())),
+    offset(0),
+    chunk()
+{}
+
+template <typename T, size_t L, typename C>
+bool FieldWriter<T, L, C>::write (std::ostream& out, size_t maxBytes) {
+    const size_t total = fileSize();
+
+    while (offset < total && maxBytes > 0) {
+        size_t count;
+
+        if (offset < planeOffset) {
+            // Header, layer records and the padding up to the first plane
+            chunk.assign(planeOffset, 0);
+
+            FieldFile::Header header;
+            std::memcpy(header.magic, FieldFile::MAGIC, sizeof(header.magic));
+            header.version = FieldFile::VERSION;
+            header.endianMark = FieldFile::ENDIAN_MARK;
+            header.width = field.width;
+            header.height = field.height;
+            header.layerCount = field.layerCount();
+            header.planeOffset = planeOffset;
+            std::memcpy(chunk.data(), &header, sizeof(header));
+
+            for (size_t layer = 0; layer < field.layerCount(); ++layer) {
+                const FieldFile::LayerRecord record = {
+                    field.layers[layer].built,
+                    field.layers[layer].buildId,
+                    field.layers[layer].mode,
+                    0
+                };
+                std::memcpy(chunk.data() + sizeof(header) + layer * sizeof(record), &record, sizeof(record));
+            }
+
+            count = std::min((size_t)planeOffset - offset, maxBytes);
+            out.write((const char *)chunk.data() + offset, count);
+        } else {
+            count = std::min(std::min(total - offset, maxBytes), FieldFile::CHUNK_SIZE);
+            fillPlanes(offset - planeOffset, count);
+            out.write((const char *)chunk.data(), count);
+        }
+
+        if (!out)
+            throw std::runtime_error("Failed to write field");
+
+        offset += count;
+        maxBytes -= count;
+    }
+
+    return offset == total;
+}
+
+/// Copy `count` plane bytes starting at `position` into the chunk
+template <typename T, size_t L, typename C>
+void FieldWriter<T, L, C>::fillPlanes (size_t position, size_t count) {
+    chunk.resize(count);
+
+    const uint8_t * raw = FieldFile::rawPlanes(field.cells);
+    if (raw != nullptr) {
+        std::memcpy(chunk.data(), raw + position, count);
+        return;
+    }
+
+    const size_t cellCount = field.cells.size();
+    const size_t stride = field.cells.directionStride();
+
+    for (size_t i = 0; i < count; ++i) {
+        const size_t plane = (position + i) / cellCount;
+        const size_t cellIdx = (position + i) % cellCount;
+
+        if (plane == 0) {
+            auto&& cell = field.cells[cellIdx];
+            chunk[i] = cell.getEntryDir() | (cell.getAllowDiagonal() ? 0x10 : 0);
+        } else if (plane == 1) {
+            chunk[i] = field.cells[cellIdx].getCost();
+        } else if (plane < 2 + field.layerCount()) {
+            chunk[i] = field.cells.directionData(plane - 2)[cellIdx * stride];
+        } else {
+            chunk[i] = 0; // Plane padding
+        }
+    }
+}
+
+template <typename T, size_t L, typename C>
+void saveField (Field_t<T, L, C>& field, const std::string& path) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Cannot open " + path);
+
+    FieldWriter<T, L, C>(field).write(out);
+}
+
+template <typename T, size_t L>
+MappedField<T, L>::MappedField (const std::string& path) :
+    mapping(nullptr),
+    mappingSize(0),
+    mappedField()
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(FieldFile::Header)) {
+        close(fd);
+        throw std::runtime_error("Not a field file: " + path);
+    }
+
+    mappingSize = fileStat.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw std::runtime_error("Cannot map " + path);
+    }
+
+    uint8_t * base = (uint8_t *)mapping;
+    FieldFile::Header header;
+    std::memcpy(&header, base, sizeof(header));
+
+    const char * error = nullptr;
+    if (std::memcmp(header.magic, FieldFile::MAGIC, sizeof(header.magic)) != 0)
+        error = "Not a field file: ";
+    else if (header.version != FieldFile::VERSION)
+        error = "Unsupported field file version: ";
+    else if (header.endianMark != FieldFile::ENDIAN_MARK)
+        error = "Field file written with another byte order: ";
+    else if (L != DYNAMIC_LAYERS && header.layerCount != L)
+        error = "Field file layer count does not match: ";
+    else if ((uint64_t)(T)header.width != header.width || (uint64_t)(T)header.height != header.height)
+        error = "Field file dimensions do not fit the dimension type: ";
+    else if (header.planeOffset != FieldFile::planeOffset(header.layerCount) ||
+             mappingSize < header.planeOffset + PlanarCells<L>::planeBytes(header.width * header.height, header.layerCount))
+        error = "Truncated field file: ";
+
+    if (error != nullptr) {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        throw std::runtime_error(error + path);
+    }
+
+    mappedField.reset(new FieldType((T)header.width, (T)header.height, base + header.planeOffset, (size_t)header.layerCount));
+
+    for (size_t layer = 0; layer < header.layerCount; ++layer) {
+        FieldFile::LayerRecord record;
+        std::memcpy(&record, base + sizeof(header) + layer * sizeof(record), sizeof(record));
+
+        mappedField->layers[layer].built = record.built != 0;
+        mappedField->layers[layer].buildId = record.buildId;
+        mappedField->layers[layer].generation = record.buildId; // Resumes the ID sequence, see Field_t::nextBuildId
+        mappedField->layers[layer].mode = (BuildModes::BuildMode_t)record.mode;
+    }
+}
+
+template <typename T, size_t L>
+MappedField<T, L>::~MappedField () {
+    mappedField.reset();
+
+    if (mapping != nullptr)
+        munmap(mapping, mappingSize);
+}
+
+} // namespace flow
+
+#endif // field_file_cpp
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "field.hpp"
+#include "planarCells.hpp"
+
+namespace flow {
+    /* Binary field file.
+     *
+     * A file starts with a Header and one LayerRecord per layer. The cell planes
+     * start at Header::planeOffset (page aligned) and are laid out exactly like
+     * the planes of PlanarCells: access plane, cost plane, one direction plane
+     * per layer (direction and build ID) and the plane padding. Values are
+     * stored in the byte order of the machine that wrote the file.
+     *
+     * Because of that layout, a MappedField uses the mapped file as its cell
+     * storage directly, without copying or rebuilding anything.
+     */
+    namespace FieldFile {
+        static const char MAGIC[8] = {'F', 'L', 'O', 'W', 'F', 'L', 'D', '\0'};
+        static const uint32_t VERSION = 1;
+        static const uint32_t ENDIAN_MARK = 0x01020304;
+        static const uint64_t PLANE_ALIGNMENT = 4096;
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t endianMark;
+            uint64_t width;
+            uint64_t height;
+            uint64_t layerCount;
+            uint64_t planeOffset;
+        };
+
+        struct LayerRecord {
+            uint8_t built;
+            uint8_t buildId;
+            uint8_t mode;
+            uint8_t reserved;
+        };
+
+        inline uint64_t planeOffset (uint64_t layerCount) {
+            const uint64_t headerBytes = sizeof(Header) + layerCount * sizeof(LayerRecord);
+            return (headerBytes + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT * PLANE_ALIGNMENT;
+        }
+    }
+
+    /* Streams a field to the file format in bounded steps.
+     *
+     * write() only reads the field, so queries can keep running between (or
+     * during) the steps. Layers must not be rebuilt or repaired until the
+     * writer is done, otherwise the file mixes both versions.
+     */
+    template <typename DimensionType, size_t MaxNavLayer, typename Storage>
+    class FieldWriter {
+    public:
+        explicit FieldWriter (Field_t<DimensionType, MaxNavLayer, Storage>& _field);
+
+        /// Write up to `maxBytes` more bytes to `out`. Returns true once the whole file was written
+        bool write (std::ostream& out, size_t maxBytes = (size_t)(-1));
+
+        /// Total size of the file
+        size_t fileSize () const {
+            return (size_t)planeOffset + PlanarCells<MaxNavLayer>::planeBytes(field.cells.size(), field.layerCount());
+        }
+
+        /// Bytes written so far
+        size_t written () const {
+            return offset;
+        }
+
+    private:
+        Field_t<DimensionType, MaxNavLayer, Storage>& field;
+        uint64_t planeOffset;
+        size_t offset;
+        std::vector<uint8_t> chunk;
+
+    private:
+        void fillPlanes (size_t position, size_t count);
+    };
+
+    /// Write `field` to the file at `path`
+    template <typename DimensionType, size_t MaxNavLayer, typename Storage>
+    void saveField (Field_t<DimensionType, MaxNavLayer, Storage>& field, const std::string& path);
+
+    /* Read-only memory mapping of a field file.
+     *
+     * The mapping is private: layers can still be rebuilt or repaired, and the
+     * touched pages are copied by the OS instead of being written to the file.
+     */
+    template <typename DimensionType, size_t MaxNavLayer>
+    class MappedField {
+    public:
+        using FieldType = Field_t<DimensionType, MaxNavLayer, PlanarCells<MaxNavLayer>>;
+
+    public:
+        explicit MappedField (const std::string& path);
+        ~MappedField ();
+
+        MappedField (const MappedField&) = delete;
+        MappedField& operator= (const MappedField&) = delete;
+
+        FieldType& field () {
+            return *mappedField;
+        }
+
+        FieldType * operator-> () {
+            return mappedField.get();
+        }
+
+    private:
+        void * mapping;
+        size_t mappingSize;
+        std::unique_ptr<FieldType> mappedField;
+    };
+}
+
+#include "fieldFile.cpp"
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <stdexcept>
+
+#include "directions.hpp"
+
+namespace flow {
+    /* Layouts map cell coordinates to storage indices.
+     *
+     * A layout tells Field_t how many cells to allocate, where the cell (x, y)
+     * lives, and which cell is one step away in a direction. Linear layouts
+     * (index = origin() + y * rowStride() + x) set `linear` and also allow the
+     * vectorized batch lookups.
+     *
+     * - RowMajorLayout: cells row after row, the storage index is y * width + x (default)
+     * - PaddedLayout: the same, surrounded by a one cell wall border
+     * - TiledLayout: square tiles stored one after the other
+     * - MortonLayout: Z-order curve over the whole field
+     *
+     * Cells a layout allocates beyond the width * height field cells (border,
+     * partial tiles) are never handed out, so they stay walls.
+     */
+    class RowMajorLayout {
+    public:
+        static const bool linear = true;
+
+        RowMajorLayout (size_t _width, size_t _height) :
+            width(_width),
+            height(_height)
+        {}
+
+        /// Cells to allocate
+        inline size_t cellCount () const {
+            return width * height;
+        }
+
+        inline size_t index (size_t x, size_t y) const {
+            return y * width + x;
+        }
+
+        /// Storage index of the `idx`th cell in row order, used by the field iterator
+        inline size_t storageIndex (size_t idx) const {
+            return idx;
+        }
+
+        inline size_t origin () const {
+            return 0;
+        }
+
+        inline size_t rowStride () const {
+            return width;
+        }
+
+        /// Index of the cell one step in `dir` from `idx`, or -1 if it is outside the field
+        size_t neighbour (size_t idx, Direction_t dir) const {
+            if (idx == (size_t)-1)
+                return -1;
+
+            switch (dir) {
+                case Directions::NORTH:
+                    return (idx / width > 0 ? idx - width : -1);
+                case Directions::SOUTH:
+                    return (idx / width < (height - 1) ? idx + width : -1);
+                case Directions::EAST:
+                    return (idx % width < (width - 1) ? idx + 1 : -1);
+                case Directions::WEST:
+                    return (idx % width > 0 ? idx - 1 : -1);
+
+                case Directions::NORTH_EAST:
+                    return neighbour( neighbour(idx, Directions::NORTH), Directions::EAST );
+                case Directions::NORTH_WEST:
+                    return neighbour( neighbour(idx, Directions::NORTH), Directions::WEST );
+                case Directions::SOUTH_EAST:
+                    return neighbour( neighbour(idx, Directions::SOUTH), Directions::EAST );
+                case Directions::SOUTH_WEST:
+                    return neighbour( neighbour(idx, Directions::SOUTH), Directions::WEST );
+
+                default:
+                    return -1;
+            }
+        }
+
+    private:
+        size_t width;
+        size_t height;
+    };
+
+    /* Row major cells inside a one cell border.
+     *
+     * Border cells are never handed out by the field (at() and the iterator
+     * only reach the inner cells), so they keep the access data of a new cell
+     * and stay walls. Every inner cell therefore has 8 neighbours in the
+     * storage, and a step is a single add of a per-direction offset: no divide,
+     * modulo or bounds branch. A build reaching the border marks it as a wall
+     * like any other wall.
+     *
+     * Width and Height fix the dimensions at compile time (0 = given at
+     * runtime), which turns the row stride and the offsets into constants.
+     */
+    template <size_t Width = 0, size_t Height = 0>
+    class PaddedLayout {
+    public:
+        static const bool linear = true;
+
+        PaddedLayout (size_t _width, size_t _height) :
+            width(Width != 0 ? Width : _width),
+            stride((Width != 0 ? Width : _width) + 2),
+            paddedHeight((Height != 0 ? Height : _height) + 2)
+        {
+            if ((Width != 0 && _width != Width) || (Height != 0 && _height != Height))
+                throw std::range_error("Field dimensions do not match the layout");
+
+            for (Direction_t dir = 0; dir < 16; ++dir)
+                offsets[dir] = (ptrdiff_t)Directions::stepY[dir] * (ptrdiff_t)stride + Directions::stepX[dir];
+        }
+
+        inline size_t cellCount () const {
+            return rowStride() * paddedHeight;
+        }
+
+        inline size_t index (size_t x, size_t y) const {
+            return origin() + y * rowStride() + x;
+        }
+
+        inline size_t storageIndex (size_t idx) const {
+            const size_t w = Width != 0 ? Width : width;
+            return index(idx % w, idx / w);
+        }
+
+        inline size_t origin () const {
+            return rowStride() + 1;
+        }
+
+        inline size_t rowStride () const {
+            return Width != 0 ? Width + 2 : stride;
+        }
+
+        /// Index of the cell one step in `dir` from the inner cell `idx`. -1 if `dir` does not move (STOP, WALL, DEST)
+        inline size_t neighbour (size_t idx, Direction_t dir) const {
+            const ptrdiff_t offset = Width != 0 ? (ptrdiff_t)Directions::stepY[dir] * (ptrdiff_t)(Width + 2) + Directions::stepX[dir]
+                                                : offsets[dir];
+            return offset != 0 ? idx + offset : -1;
+        }
+
+    private:
+        size_t width;
+        size_t stride;
+        size_t paddedHeight;
+        ptrdiff_t offsets[16]; // Indexed by direction code
+    };
+
+    /* Square TileSize x TileSize tiles, each stored row major, tiles in row
+     * major order.
+     *
+     * A vertical step stays in the same tile (TileSize rows of TileSize cells)
+     * unless it crosses a tile edge, so the rows above and below a cell are
+     * usually a few cache lines away instead of a whole map row. Partial tiles
+     * at the right and bottom edges are allocated in full; their extra cells are
+     * walls, so steps inside a tile need no bounds check.
+     */
+    template <size_t TileSize = 16>
+    class TiledLayout {
+        static_assert(TileSize > 0 && (TileSize & (TileSize - 1)) == 0, "Tile size must be a power of two");
+
+        static const size_t tileCells = TileSize * TileSize;
+
+    public:
+        static const bool linear = false;
+
+        TiledLayout (size_t _width, size_t _height) :
+            width(_width),
+            height(_height),
+            tilesX((_width + TileSize - 1) / TileSize),
+            tilesY((_height + TileSize - 1) / TileSize)
+        {}
+
+        inline size_t cellCount () const {
+            return tilesX * tilesY * tileCells;
+        }
+
+        inline size_t index (size_t x, size_t y) const {
+            return ((y / TileSize) * tilesX + x / TileSize) * tileCells + (y % TileSize) * TileSize + x % TileSize;
+        }
+
+        inline size_t storageIndex (size_t idx) const {
+            return index(idx % width, idx / width);
+        }
+
+        /// Index of the cell one step in `dir` from `idx`, or -1 if it is outside the field or `dir` does not move
+        inline size_t neighbour (size_t idx, Direction_t dir) const {
+            const int32_t dx = Directions::stepX[dir];
+            const int32_t dy = Directions::stepY[dir];
+            if (dx == 0 && dy == 0)
+                return -1;
+
+            // Unsigned wrap around turns a step out of the tile (or the field) on the low side into a large value
+            const size_t inTile = idx % tileCells;
+            const size_t tileX = inTile % TileSize + dx;
+            const size_t tileY = inTile / TileSize + dy;
+            if (tileX < TileSize && tileY < TileSize)
+                return idx + dy * (ptrdiff_t)TileSize + dx;
+
+            const size_t tile = idx / tileCells;
+            const size_t x = (tile % tilesX) * TileSize + tileX;
+            const size_t y = (tile / tilesX) * TileSize + tileY;
+            return (x < width && y < height) ? index(x, y) : -1;
+        }
+
+    private:
+        size_t width;
+        size_t height;
+        size_t tilesX;
+        size_t tilesY;
+    };
+
+    /* Z-order (Morton) curve: the bits of x and y are interleaved, x in the even
+     * bits and y in the odd bits.
+     *
+     * Every aligned 2^n x 2^n block is contiguous, so locality holds at every
+     * scale without picking a tile size. The storage covers the index of the
+     * last cell: width * height cells for power of two squares (or 2:1
+     * rectangles), up to 3 times that for other squares, and more for
+     * elongated maps (21 times for 1024x16).
+     *
+     * Neighbours are computed on the interleaved index directly. Coordinates
+     * are limited to 32 bits (16 bits with a 32 bit size_t).
+     */
+    class MortonLayout {
+        static const uint64_t xBits = 0x5555555555555555ULL;
+        static const uint64_t yBits = 0xAAAAAAAAAAAAAAAAULL;
+
+    public:
+        static const bool linear = false;
+
+        MortonLayout (size_t _width, size_t _height) :
+            width(_width),
+            lastX(spread(_width > 0 ? _width - 1 : 0)),
+            lastY(spread(_height > 0 ? _height - 1 : 0) << 1),
+            count(_width > 0 && _height > 0 ? (lastX | lastY) + 1 : 0)
+        {}
+
+        inline size_t cellCount () const {
+            return count;
+        }
+
+        inline size_t index (size_t x, size_t y) const {
+            return spread(x) | (spread(y) << 1);
+        }
+
+        inline size_t storageIndex (size_t idx) const {
+            return index(idx % width, idx / width);
+        }
+
+        /// Index of the cell one step in `dir` from `idx`, or -1 if it is outside the field or `dir` does not move
+        inline size_t neighbour (size_t idx, Direction_t dir) const {
+            const int32_t dx = Directions::stepX[dir];
+            const int32_t dy = Directions::stepY[dir];
+            if (dx == 0 && dy == 0)
+                return -1;
+
+            uint64_t x = idx & xBits;
+            uint64_t y = idx & yBits;
+
+            // Interleaved increments and decrements carry through the bits of the other coordinate
+            if (dx > 0) {
+                if (x == lastX)
+                    return -1;
+                x = ((x | yBits) + 1) & xBits;
+            }
+            else if (dx < 0) {
+                if (x == 0)
+                    return -1;
+                x = (x - 1) & xBits;
+            }
+
+            if (dy > 0) {
+                if (y == lastY)
+                    return -1;
+                y = ((y | xBits) + 1) & yBits;
+            }
+            else if (dy < 0) {
+                if (y == 0)
+                    return -1;
+                y = (y - 1) & yBits;
+            }
+
+            return x | y;
+        }
+
+    private:
+        size_t width;
+        uint64_t lastX; // Spread coordinates of the last column and row
+        uint64_t lastY;
+        size_t count;
+
+    private:
+        /// Move the low 32 bits of `v` to the even bits
+        static inline uint64_t spread (uint64_t v) {
+            v &= 0xFFFFFFFFULL;
+            v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+            v = (v | (v << 8))  & 0x00FF00FF00FF00FFULL;
+            v = (v | (v << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+            v = (v | (v << 2))  & 0x3333333333333333ULL;
+            v = (v | (v << 1))  & 0x5555555555555555ULL;
+            return v;
+        }
+    };
+}
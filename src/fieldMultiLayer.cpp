@@ -0,0 +1,210 @@
+#include "field.hpp"
+
+#ifndef field_multi_layer_cpp
+#define field_multi_layer_cpp
+
+#include <algorithm>
+#include <stdexcept>
+#include "fieldCell.hpp"
+
+// Layers expanded by one traversal, the width of the widest layer mask
+#define MULTI_LAYER_GROUP 64
+
+namespace flow {
+
+template <typename T, size_t S, typename C, typename G>
+Field_t<T, S, C, G> * Field_t<T, S, C, G>::addPointOfInterest (const LayerPointOfInterests& layerPoi) {
+    return addPointOfInterest(layerPoi, BuildWorkspace::local());
+}
+
+template <typename T, size_t S, typename C, typename G>
+Field_t<T, S, C, G> * Field_t<T, S, C, G>::addPointOfInterest (const LayerPointOfInterests& layerPoi, BuildWorkspace& workspace) {
+    static_assert(!C::streamed, "Multi-layer builds keep layer masks of the whole map, build the layers of streamed storages one by one");
+
+    auto& listed = workspace.listedLayers;
+    listed.assign(layerCount(), false);
+    for (const auto& entry : layerPoi) {
+        if (entry.first >= layerCount())
+            throw std::range_error("Layer out of range");
+
+        if (listed[entry.first])
+            throw std::invalid_argument("Layer listed more than once");
+
+        listed[entry.first] = true;
+    }
+
+    // The narrowest mask keeps the two per-cell mask arrays small
+    for (size_t first = 0; first < layerPoi.size(); first += MULTI_LAYER_GROUP) {
+        const size_t count = std::min<size_t>(MULTI_LAYER_GROUP, layerPoi.size() - first);
+
+        if (count <= 8)
+            buildLayers(&layerPoi[first], count, workspace.layerMasks<uint8_t>());
+        else if (count <= 16)
+            buildLayers(&layerPoi[first], count, workspace.layerMasks<uint16_t>());
+        else if (count <= 32)
+            buildLayers(&layerPoi[first], count, workspace.layerMasks<uint32_t>());
+        else
+            buildLayers(&layerPoi[first], count, workspace.layerMasks<uint64_t>());
+    }
+
+    return this;
+}
+
+/* Bit-parallel multi-layer build.
+ *
+ * Every layer of the group gets a bit of Mask. `reached` holds, per cell, the
+ * layers that settled the cell, and the frontier holds each cell once with
+ * the layers that reached it in the current level. A frontier cell is
+ * expanded for all of its layers at once: the neighbour lookup and the
+ * wall, diagonal and entry checks are done once, and only the direction and
+ * build ID writes are made per layer.
+ *
+ * Layers advance one level at a time, so every layer gets the same distances
+ * as a separate build. A cell is owned by the first cell of the shared
+ * frontier that reaches it, so where two routes are equally short a layer can
+ * point along the other one than a separate build would. A group of a single
+ * layer is identical to addPointOfInterest.
+ *
+ * Build statistics are per layer, except the timings, which are those of the
+ * whole group.
+ */
+template <typename T, size_t S, typename C, typename G>
+template <typename Mask>
+void Field_t<T, S, C, G>::buildLayers (const std::pair<size_t, PointOfInterests> * group, size_t count, LayerMasks<Mask>& masks) {
+    FLOW_STATS(StatsTimer timer);
+
+    size_t layerOf[MULTI_LAYER_GROUP];
+    uint8_t buildIds[MULTI_LAYER_GROUP];
+    uint32_t * distances[MULTI_LAYER_GROUP];
+
+    for (size_t slot = 0; slot < count; ++slot) {
+        const size_t layer = group[slot].first;
+        FLOW_TRACE_EVENT(BUILD_BEGIN, layer);
+        FLOW_STATS(beginStats(layer, BuildModes::BREADTH_FIRST, false));
+
+        layerOf[slot] = layer;
+        buildIds[slot] = nextBuildId(layer);
+        distances[slot] = resetDistances(layer);
+    }
+
+    auto& reached = masks.reached;
+    auto& pending = masks.pending;         // Layers that reached a cell in the level being expanded
+    auto& discovered = masks.discovered;   // Cells of the next level, in discovery order
+    auto& frontier = masks.frontier;
+    reached.assign(cells.size(), 0);
+    pending.assign(cells.size(), 0);
+    discovered.clear();
+
+    // Load POIs to the first level and mark them as the destination
+    for (size_t slot = 0; slot < count; ++slot) {
+        const Mask bit = (Mask)((Mask)1 << slot);
+
+        for (auto point : group[slot].second) {
+            const auto cellIdx = vec2ToArrayIdx(point);
+            cells[cellIdx].setDirection(layerOf[slot], Directions::DEST);
+            cells[cellIdx].setBuildId(layerOf[slot], buildIds[slot]);
+
+            if (distances[slot] != nullptr)
+                distances[slot][cellIdx] = 0;
+
+            if (pending[cellIdx] == 0)
+                discovered.push_back(cellIdx);
+            pending[cellIdx] |= bit;
+            reached[cellIdx] |= bit;
+        }
+    }
+
+    FLOW_STATS(const double seedMs = timer.lapMs());
+    for (size_t slot = 0; slot < count; ++slot)
+        FLOW_TRACE_EVENT(SEED_END, layerOf[slot]);
+
+    FLOW_STATS(uint64_t levelCells[MULTI_LAYER_GROUP] = {});
+
+    const Direction_t * directions = Directions::expansionOrder;
+
+    for (uint32_t level = 1; !discovered.empty(); ++level) {
+        frontier.clear();
+        for (auto cellIdx : discovered) {
+            frontier.emplace_back(cellIdx, pending[cellIdx]);
+            FLOW_STATS(for (size_t slot = 0; slot < count; ++slot) levelCells[slot] += (pending[cellIdx] >> slot) & 1);
+            pending[cellIdx] = 0;
+        }
+        discovered.clear();
+
+        FLOW_STATS(for (size_t slot = 0; slot < count; ++slot) {
+            auto& stats = layers[layerOf[slot]].stats;
+            stats.cellsVisited += levelCells[slot];
+            stats.cellsEnqueued += levelCells[slot];
+            stats.peakQueueDepth = std::max<uint64_t>(stats.peakQueueDepth, levelCells[slot]);
+            levelCells[slot] = 0;
+        });
+
+        for (const auto& entry : frontier) {
+            const auto cellIdx = entry.first;
+
+            for (auto i = 0; directions[i] != Directions::STOP; ++i) {
+                const auto neighbourCellIdx = moveIndexByDirection(cellIdx, directions[i]);
+                if (neighbourCellIdx == (size_t)(-1))
+                    continue;
+
+                // Layers of this cell that have not settled the neighbour yet
+                const Mask fresh = entry.second & ~reached[neighbourCellIdx];
+                if (fresh == 0)
+                    continue;
+
+                if (cells[neighbourCellIdx].isWall()) {
+                    reached[neighbourCellIdx] |= fresh;
+                    for (size_t slot = 0; slot < count && (fresh >> slot) != 0; ++slot) {
+                        if (((fresh >> slot) & 1) == 0)
+                            continue;
+
+                        cells[neighbourCellIdx].setBuildId(layerOf[slot], buildIds[slot]);
+                        cells[neighbourCellIdx].markDirAsWall(layerOf[slot]);
+                        FLOW_STATS(++layers[layerOf[slot]].stats.wallsMarked);
+                    }
+                    continue;
+                }
+
+                if (Directions::isDiagonal(directions[i]) && !cells[neighbourCellIdx].getAllowDiagonal())
+                    continue;
+
+                const auto dirFromNeighbourToCurrentCell = Directions::negateDir(directions[i]);
+                if (!cells[cellIdx].canEnterFrom(dirFromNeighbourToCurrentCell))
+                    continue;
+
+                reached[neighbourCellIdx] |= fresh;
+                if (pending[neighbourCellIdx] == 0)
+                    discovered.push_back(neighbourCellIdx);
+                pending[neighbourCellIdx] |= fresh;
+
+                for (size_t slot = 0; slot < count && (fresh >> slot) != 0; ++slot) {
+                    if (((fresh >> slot) & 1) == 0)
+                        continue;
+
+                    cells[neighbourCellIdx].setBuildId(layerOf[slot], buildIds[slot]);
+                    cells[neighbourCellIdx].setDirection(layerOf[slot], dirFromNeighbourToCurrentCell);
+
+                    if (distances[slot] != nullptr)
+                        distances[slot][neighbourCellIdx] = level;
+                }
+            }
+        }
+    }
+
+    FLOW_STATS(const double expandMs = timer.lapMs());
+
+    for (size_t slot = 0; slot < count; ++slot) {
+        finishBuild(layerOf[slot], buildIds[slot], BuildModes::BREADTH_FIRST);
+        FLOW_STATS(auto& stats = layers[layerOf[slot]].stats; stats.seedMs = seedMs; stats.expandMs = expandMs);
+    }
+
+    FLOW_STATS(for (size_t slot = 0; slot < count; ++slot) layers[layerOf[slot]].stats.totalMs = timer.totalMs());
+    for (size_t slot = 0; slot < count; ++slot)
+        FLOW_TRACE_EVENT(BUILD_END, layerOf[slot]);
+}
+
+} // namespace flow
+
+#undef MULTI_LAYER_GROUP
+
+#endif // field_multi_layer_cpp
@@ -0,0 +1,217 @@
+#include "field.hpp"
+
+#ifndef field_parallel_cpp
+#define field_parallel_cpp
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include "fieldCell.hpp"
+
+// Minimum number of frontier cells handed to a worker. Smaller levels are expanded on the calling thread
+#define PARALLEL_GRAIN 2048
+
+namespace flow {
+
+template <typename T, size_t S, typename C, typename G>
+Field_t<T, S, C, G> * Field_t<T, S, C, G>::addPointOfInterest (size_t layer, const PointOfInterests& poi, ThreadPool& pool) {
+    static_assert(!C::streamed, "Streamed storages load tiles from a single thread, build them with the serial addPointOfInterest");
+
+    FLOW_TRACE_EVENT(BUILD_BEGIN, layer);
+    FLOW_STATS(StatsTimer timer);
+    FLOW_STATS(BuildStats& stats = beginStats(layer, BuildModes::BREADTH_FIRST, false));
+
+    const uint8_t buildId = nextBuildId(layer);
+    uint32_t * distance = resetDistances(layer);
+    std::vector<size_t> seeds;
+    seeds.reserve(poi.size());
+
+    // Load POIs to the first frontier and mark them as the destination
+    for (auto point : poi) {
+        const auto cellIdx = vec2ToArrayIdx(point);
+        seeds.push_back(cellIdx);
+        cells[cellIdx].setDirection(layer, Directions::DEST);
+        cells[cellIdx].setBuildId(layer, buildId);
+
+        if (distance != nullptr)
+            distance[cellIdx] = 0;
+    }
+
+    FLOW_STATS(stats.seedMs = timer.lapMs());
+    FLOW_TRACE_EVENT(SEED_END, layer);
+
+    // Claim keys pack (frontier position * 8 + expansion order), so they must fit the widest frontier
+    const size_t maxFrontier = std::max((size_t)width * height, seeds.size());
+    if (maxFrontier < std::numeric_limits<uint32_t>::max() / 8)
+        expandParallel<uint32_t>(layer, buildId, seeds, pool);
+    else
+        expandParallel<uint64_t>(layer, buildId, seeds, pool);
+
+    FLOW_STATS(stats.expandMs = timer.lapMs());
+    finishBuild(layer, buildId, BuildModes::BREADTH_FIRST);
+    FLOW_STATS(stats.totalMs = timer.totalMs());
+    FLOW_TRACE_EVENT(BUILD_END, layer);
+
+    return this;
+}
+
+/* Frontier-synchronous BFS.
+ *
+ * The serial build pops cells in FIFO order, so a cell is owned by the first
+ * cell of the previous level (in queue order) that reaches it, and ties on the
+ * same cell are broken by the expansion order. Each level is therefore
+ * expanded in two phases separated by a barrier:
+ *
+ * 1. Propose: every frontier cell runs the same checks as the serial build and
+ *    writes (frontier position * 8 + expansion order) to the neighbour's claim
+ *    slot with an atomic min. Cells are only read in this phase.
+ * 2. Settle: the proposal holding the smallest key wins and writes the
+ *    direction and build ID. Winners are appended to the next frontier in chunk
+ *    order, which keeps the next frontier in the same order as the serial queue.
+ */
+template <typename T, size_t S, typename C, typename G>
+template <typename ClaimKey>
+void Field_t<T, S, C, G>::expandParallel (size_t layer, uint8_t buildId, const std::vector<size_t>& seeds, ThreadPool& pool) {
+    static_assert(!C::streamed, "Streamed storages load tiles from a single thread");
+
+    struct Candidate {
+        size_t cellIdx;
+        ClaimKey key;
+        Direction_t dir; // Directions::WALL if the candidate should be marked as a wall
+    };
+
+    const size_t cellCount = cells.size();
+    const size_t workerCount = pool.size();
+    const ClaimKey unclaimed = std::numeric_limits<ClaimKey>::max();
+    const Direction_t * directions = Directions::expansionOrder;
+
+    std::unique_ptr<std::atomic<ClaimKey>[]> claims(new std::atomic<ClaimKey>[cellCount]);
+    pool.run([&](size_t worker) {
+        const size_t end = cellCount * (worker + 1) / workerCount;
+        for (size_t i = cellCount * worker / workerCount; i < end; ++i)
+            claims[i].store(unclaimed, std::memory_order_relaxed);
+    });
+
+    // The frontier is kept as one segment per chunk so it never has to be flattened
+    std::vector<std::vector<size_t>> frontier(workerCount), nextFrontier(workerCount);
+    std::vector<std::vector<Candidate>> candidates(workerCount);
+    std::vector<size_t> offsets(workerCount + 1);
+    frontier[0] = seeds;
+
+    // Walls are counted per chunk, the other statistics follow from the frontier sizes
+    FLOW_STATS(BuildStats& stats = layers[layer].stats);
+    FLOW_STATS(std::vector<uint64_t> chunkWalls(workerCount, 0));
+
+    uint32_t * distance = distancePlane(layer);
+    uint32_t level = 0; // Distance of the current frontier
+    size_t chunkCount = 0;
+    size_t total = 0;
+
+    auto propose = [&](size_t chunk) {
+        if (chunk >= chunkCount)
+            return;
+
+        const size_t begin = total * chunk / chunkCount;
+        const size_t end = total * (chunk + 1) / chunkCount;
+        auto& out = candidates[chunk];
+
+        size_t segment = std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin() - 1;
+        for (size_t pos = begin; pos < end; ++pos) {
+            while (pos >= offsets[segment + 1])
+                ++segment;
+
+            const auto cellIdx = frontier[segment][pos - offsets[segment]];
+
+            for (auto i = 0; directions[i] != Directions::STOP; ++i) {
+                const auto neighbourCellIdx = moveIndexByDirection(cellIdx, directions[i]);
+                if (neighbourCellIdx == (size_t)(-1))
+                    continue;
+
+                // Cells settled in a previous level are final
+                if (cells[neighbourCellIdx].getBuildId(layer) == buildId)
+                    continue;
+
+                Direction_t dir = Directions::WALL;
+                if (!cells[neighbourCellIdx].isWall()) {
+                    if (Directions::isDiagonal(directions[i]) && !cells[neighbourCellIdx].getAllowDiagonal())
+                        continue;
+
+                    dir = Directions::negateDir(directions[i]);
+                    if (!cells[cellIdx].canEnterFrom(dir))
+                        continue;
+                }
+
+                // Atomic min. Only keep the candidate if it is currently the best proposal
+                const ClaimKey key = (ClaimKey)pos * 8 + i;
+                auto& claim = claims[neighbourCellIdx];
+                ClaimKey seen = claim.load(std::memory_order_relaxed);
+                while (key < seen && !claim.compare_exchange_weak(seen, key, std::memory_order_relaxed)) {}
+
+                if (key < seen)
+                    out.push_back({neighbourCellIdx, key, dir});
+            }
+        }
+    };
+
+    auto settle = [&](size_t chunk) {
+        if (chunk >= chunkCount)
+            return;
+
+        auto& next = nextFrontier[chunk];
+        for (const auto& candidate : candidates[chunk]) {
+            if (claims[candidate.cellIdx].load(std::memory_order_relaxed) != candidate.key)
+                continue;
+
+            cells[candidate.cellIdx].setBuildId(layer, buildId);
+            if (candidate.dir == Directions::WALL) {
+                cells[candidate.cellIdx].markDirAsWall(layer);
+                FLOW_STATS(++chunkWalls[chunk]);
+            } else {
+                cells[candidate.cellIdx].setDirection(layer, candidate.dir);
+                next.push_back(candidate.cellIdx);
+
+                if (distance != nullptr)
+                    distance[candidate.cellIdx] = level + 1;
+            }
+        }
+        candidates[chunk].clear();
+    };
+
+    while (true) {
+        offsets[0] = 0;
+        for (size_t i = 0; i < workerCount; ++i)
+            offsets[i + 1] = offsets[i] + frontier[i].size();
+
+        total = offsets[workerCount];
+        if (total == 0)
+            break;
+
+        FLOW_STATS(stats.cellsVisited += total; stats.cellsEnqueued += total);
+        FLOW_STATS(stats.peakQueueDepth = std::max<uint64_t>(stats.peakQueueDepth, total));
+
+        chunkCount = std::min(workerCount, (total + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+        if (chunkCount == 1) {
+            propose(0);
+            settle(0);
+        } else {
+            pool.run(propose);
+            pool.run(settle);
+        }
+
+        for (size_t i = 0; i < workerCount; ++i) {
+            frontier[i].clear();
+            frontier[i].swap(nextFrontier[i]);
+        }
+
+        ++level;
+    }
+
+    FLOW_STATS(for (auto walls : chunkWalls) stats.wallsMarked += walls);
+}
+
+} // namespace flow
+
+#undef PARALLEL_GRAIN
+
+#endif // field_parallel_cpp
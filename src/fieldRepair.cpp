@@ -0,0 +1,365 @@
+#include "field.hpp"
+
+#ifndef field_repair_cpp
+#define field_repair_cpp
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include "fieldCell.hpp"
+
+namespace flow {
+
+template <typename T, size_t S, typename C, typename G>
+Field_t<T, S, C, G> * Field_t<T, S, C, G>::updateCells (const std::vector<Vec2>& changedCells) {
+    for (size_t layer = 0; layer < layerCount(); ++layer)
+        if (layers[layer].built)
+            updateCells(layer, changedCells);
+
+    return this;
+}
+
+/* Incremental repair.
+ *
+ * A built layer is a forest where every cell points to its parent. Changing the
+ * access data of a cell can only break the edges into and out of that cell, so
+ * only the changed cells and their subtrees (the cells whose route flowed
+ * through them) lose their direction. Those cells are reset and re-expanded by
+ * a BFS seeded from the neighbouring cells that kept a valid route. Each seed
+ * enters the BFS at its hop distance to the destination, so the repaired
+ * routes are as short as the ones a full rebuild would produce. Weighted
+ * layers use the weighted distance and a Dijkstra search instead of the BFS.
+ *
+ * Opening cells can also shorten routes that are still valid. A last pass
+ * lowers distances outwards from the re-routed cells, like the decrease step
+ * of LPA*: a routed neighbour that gets closer through a cell is pointed at
+ * it, and the drop spreads to the cells routed through that neighbour.
+ * Routes are then as short as after a full rebuild, and the pass only visits
+ * cells whose distance dropped. The distance of a routed cell is read from
+ * the distance plane if the layer keeps one, and walked along its route
+ * otherwise.
+ */
+template <typename T, size_t S, typename C, typename G>
+Field_t<T, S, C, G> * Field_t<T, S, C, G>::updateCells (size_t layer, const std::vector<Vec2>& changedCells) {
+    if (!layers[layer].built)
+        return this;
+
+    FLOW_TRACE_EVENT(REPAIR_BEGIN, layer);
+    FLOW_STATS(StatsTimer timer);
+    FLOW_STATS(BuildStats& stats = beginStats(layer, layers[layer].mode, true));
+
+    const uint8_t buildId = layers[layer].buildId;
+    // Eikonal layers are repaired along the grid, with the costs of a weighted layer
+    const bool weighted = layers[layer].mode == BuildModes::WEIGHTED || layers[layer].mode == BuildModes::EIKONAL;
+    const uint8_t staleId = 0; // Never issued to a build
+    const uint32_t unreachable = (uint32_t)(-1);
+    const size_t cellCount = cells.size();
+    const Direction_t * directions = Directions::expansionOrder;
+    uint32_t * plane = distancePlane(layer);
+
+    auto isRouted = [&](size_t idx) {
+        return cells[idx].getBuildId(layer) == buildId && cells[idx].getDirection(layer) != Directions::WALL;
+    };
+
+    auto isDest = [&](size_t idx) {
+        return isRouted(idx) && cells[idx].getDirection(layer) == Directions::DEST;
+    };
+
+    // Repaired cells of eikonal layers follow their new direction, see getGradient
+    auto clearGradient = [&](size_t idx) {
+        if (!layers[layer].gradients.empty()) {
+            layers[layer].gradients[idx * 2] = 0;
+            layers[layer].gradients[idx * 2 + 1] = 0;
+        }
+    };
+
+    auto invalidate = [&](size_t idx) {
+        cells[idx].setBuildId(layer, staleId);
+        cells[idx].markDirAsStop(layer);
+
+        if (plane != nullptr)
+            plane[idx] = UNREACHABLE_DISTANCE;
+
+        clearGradient(idx);
+    };
+
+    // Reset the changed cells and every cell whose route flowed through them.
+    // Destinations stay destinations, only their subtree is re-routed
+    std::vector<size_t> invalid;
+    for (auto point : changedCells) {
+        const auto cellIdx = vec2ToArrayIdx(point);
+        if (!isDest(cellIdx))
+            invalidate(cellIdx);
+
+        invalid.push_back(cellIdx);
+    }
+
+    for (size_t i = 0; i < invalid.size(); ++i) {
+        const auto cellIdx = invalid[i];
+
+        for (auto d = 0; directions[d] != Directions::STOP; ++d) {
+            const auto neighbourCellIdx = moveIndexByDirection(cellIdx, directions[d]);
+            if (neighbourCellIdx == (size_t)(-1) || !isRouted(neighbourCellIdx) || isDest(neighbourCellIdx))
+                continue;
+
+            if (moveIndexByDirection(neighbourCellIdx, cells[neighbourCellIdx].getDirection(layer)) != cellIdx)
+                continue;
+
+            invalidate(neighbourCellIdx);
+            invalid.push_back(neighbourCellIdx);
+        }
+    }
+
+    // Distance to the destination, following the existing directions. Shared path suffixes are only walked once
+    std::unordered_map<size_t, uint32_t> hops;
+    auto stepDistance = [&](size_t cellIdx, Direction_t dir) -> uint32_t {
+        return weighted ? BuildModes::stepWeight(cells[cellIdx].getCost(), Directions::isDiagonal(dir)) : 1;
+    };
+
+    auto hopsToDest = [&](size_t cellIdx) -> uint32_t {
+        std::vector<size_t> path;
+        uint32_t distance = 0;
+
+        while (true) {
+            auto found = hops.find(cellIdx);
+            if (found != hops.end()) {
+                distance = found->second;
+                break;
+            }
+
+            if (cellIdx == (size_t)(-1) || !isRouted(cellIdx) || path.size() > cellCount)
+                return unreachable;
+
+            // Layers that kept their distances since their last build know them without a walk
+            if (plane != nullptr && plane[cellIdx] != UNREACHABLE_DISTANCE) {
+                distance = hops[cellIdx] = plane[cellIdx];
+                break;
+            }
+
+            if (isDest(cellIdx)) {
+                hops[cellIdx] = 0;
+                break;
+            }
+
+            path.push_back(cellIdx);
+            cellIdx = moveIndexByDirection(cellIdx, cells[cellIdx].getDirection(layer));
+        }
+
+        if (distance == unreachable)
+            return unreachable;
+
+        for (auto itr = path.rbegin(); itr != path.rend(); ++itr) {
+            distance += stepDistance(*itr, cells[*itr].getDirection(layer));
+            hops[*itr] = distance;
+        }
+
+        return distance;
+    };
+
+    // Seed the BFS with every routed cell bordering the reset region
+    std::unordered_set<size_t> seen;
+    std::vector<std::pair<uint32_t, size_t>> seeds;
+    auto addSeed = [&](size_t cellIdx) {
+        if (cellIdx == (size_t)(-1) || !isRouted(cellIdx) || !seen.insert(cellIdx).second)
+            return;
+
+        const auto distance = hopsToDest(cellIdx);
+        if (distance != unreachable)
+            seeds.push_back({distance, cellIdx});
+    };
+
+    for (auto cellIdx : invalid) {
+        addSeed(cellIdx);
+
+        for (auto d = 0; directions[d] != Directions::STOP; ++d)
+            addSeed(moveIndexByDirection(cellIdx, directions[d]));
+    }
+
+    FLOW_STATS(stats.cellsEnqueued = stats.peakQueueDepth = seeds.size(); stats.seedMs = timer.lapMs());
+    FLOW_TRACE_EVENT(SEED_END, layer);
+
+    if (weighted)
+        repairWeighted(layer, buildId, seeds, hops);
+    else
+        repairBreadthFirst(layer, buildId, seeds, hops);
+
+    /* Lower the routes that now pass closer to the destination, from the reset
+     * region outwards. `spread` holds the distance each cell was queued with.
+     * The cells routed through a queued cell get closer with it, so they are
+     * queued in turn to pass the drop on to their other neighbours.
+     */
+    typedef std::pair<uint32_t, size_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> lowered;
+    std::unordered_map<size_t, uint32_t> spread;
+    for (auto cellIdx : invalid) {
+        const auto found = hops.find(cellIdx);
+        if (found != hops.end() && isRouted(cellIdx) && spread.insert(*found).second)
+            lowered.push({found->second, cellIdx});
+    }
+
+    while (!lowered.empty()) {
+        const auto current = lowered.top();
+        const auto cellIdx = current.second;
+        lowered.pop();
+
+        // Skip entries whose distance was lowered again after they were queued
+        if (spread[cellIdx] != current.first)
+            continue;
+
+        FLOW_STATS(++stats.cellsVisited);
+
+        for (auto d = 0; directions[d] != Directions::STOP; ++d) {
+            const auto neighbourCellIdx = moveIndexByDirection(cellIdx, directions[d]);
+            if (neighbourCellIdx == (size_t)(-1) || !isRouted(neighbourCellIdx) || isDest(neighbourCellIdx))
+                continue;
+
+            const bool diagonal = Directions::isDiagonal(directions[d]);
+            if (diagonal && !cells[neighbourCellIdx].getAllowDiagonal())
+                continue;
+
+            auto dirFromNeighbourToCurrentCell = Directions::negateDir(directions[d]);
+            if (!cells[cellIdx].canEnterFrom(dirFromNeighbourToCurrentCell))
+                continue;
+
+            const uint32_t newDistance = current.first + stepDistance(neighbourCellIdx, directions[d]);
+            if (cells[neighbourCellIdx].getDirection(layer) == dirFromNeighbourToCurrentCell) {
+                const auto queued = spread.find(neighbourCellIdx);
+                if (queued != spread.end() && queued->second == newDistance)
+                    continue;
+            } else {
+                if (newDistance >= hopsToDest(neighbourCellIdx))
+                    continue;
+
+                cells[neighbourCellIdx].setDirection(layer, dirFromNeighbourToCurrentCell);
+                clearGradient(neighbourCellIdx);
+            }
+
+            hops[neighbourCellIdx] = spread[neighbourCellIdx] = newDistance;
+            lowered.push({newDistance, neighbourCellIdx});
+
+            if (plane != nullptr)
+                plane[neighbourCellIdx] = newDistance;
+
+            FLOW_STATS(++stats.cellsEnqueued; stats.peakQueueDepth = std::max<uint64_t>(stats.peakQueueDepth, lowered.size()));
+        }
+    }
+
+    FLOW_STATS(stats.expandMs = timer.lapMs(); stats.totalMs = timer.totalMs());
+    FLOW_TRACE_EVENT(REPAIR_END, layer);
+
+    return this;
+}
+
+/// Multi-source BFS from the seeds into the cells left without a route. Each seed is injected once the queue reaches its distance
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::repairBreadthFirst (size_t layer, uint8_t buildId, std::vector<std::pair<uint32_t, size_t>>& seeds, std::unordered_map<size_t, uint32_t>& distance) {
+    const Direction_t * directions = Directions::expansionOrder;
+    FLOW_STATS(BuildStats& stats = layers[layer].stats);
+    uint32_t * plane = distancePlane(layer);
+
+    std::sort(seeds.begin(), seeds.end());
+
+    std::queue<std::pair<uint32_t, size_t>> cellQueue;
+    size_t nextSeed = 0;
+
+    while (nextSeed < seeds.size() || !cellQueue.empty()) {
+        std::pair<uint32_t, size_t> current;
+        if (cellQueue.empty() || (nextSeed < seeds.size() && seeds[nextSeed].first <= cellQueue.front().first)) {
+            current = seeds[nextSeed++];
+        } else {
+            current = cellQueue.front();
+            cellQueue.pop();
+        }
+
+        FLOW_STATS(++stats.cellsVisited);
+
+        for (auto d = 0; directions[d] != Directions::STOP; ++d) {
+            const auto neighbourCellIdx = expandNeighbour(layer, buildId, current.second, directions[d]);
+            if (neighbourCellIdx != (size_t)(-1)) {
+                cellQueue.push({current.first + 1, neighbourCellIdx});
+                distance[neighbourCellIdx] = current.first + 1;
+                FLOW_STATS(++stats.cellsEnqueued);
+
+                if (plane != nullptr)
+                    plane[neighbourCellIdx] = current.first + 1;
+            }
+        }
+
+        FLOW_STATS(stats.peakQueueDepth = std::max<uint64_t>(stats.peakQueueDepth, cellQueue.size() + seeds.size() - nextSeed));
+    }
+}
+
+/// Dijkstra search from the seeds into the cells left without a route. Cells that kept their route are never changed
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::repairWeighted (size_t layer, uint8_t buildId, const std::vector<std::pair<uint32_t, size_t>>& seeds, std::unordered_map<size_t, uint32_t>& distance) {
+    typedef std::pair<uint32_t, size_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> cellQueue(seeds.begin(), seeds.end());
+    std::unordered_set<size_t> repaired;
+    const Direction_t * directions = Directions::expansionOrder;
+    FLOW_STATS(BuildStats& stats = layers[layer].stats);
+    uint32_t * plane = distancePlane(layer);
+
+    while (!cellQueue.empty()) {
+        const auto current = cellQueue.top();
+        const auto cellIdx = current.second;
+        cellQueue.pop();
+
+        // Skip entries whose distance was improved after they were queued
+        if (distance[cellIdx] != current.first)
+            continue;
+
+        FLOW_STATS(++stats.cellsVisited);
+
+        for (auto i = 0; directions[i] != Directions::STOP; ++i) {
+            const auto neighbourCellIdx = moveIndexByDirection(cellIdx, directions[i]);
+            if (neighbourCellIdx == (size_t)(-1))
+                continue;
+
+            const bool inBuild = cells[neighbourCellIdx].getBuildId(layer) == buildId;
+
+            // Skip cell if wall. Also mark it as a wall
+            if (cells[neighbourCellIdx].isWall()) {
+                if (!inBuild) {
+                    cells[neighbourCellIdx].setBuildId(layer, buildId);
+                    cells[neighbourCellIdx].markDirAsWall(layer);
+                    FLOW_STATS(++stats.wallsMarked);
+                }
+                continue;
+            }
+
+            // Only cells without a route, or routed by this repair, may change
+            if (inBuild && repaired.count(neighbourCellIdx) == 0)
+                continue;
+
+            const bool diagonal = Directions::isDiagonal(directions[i]);
+            if (diagonal && !cells[neighbourCellIdx].getAllowDiagonal())
+                continue;
+
+            auto dirFromNeighbourToCurrentCell = Directions::negateDir(directions[i]);
+            if (!cells[cellIdx].canEnterFrom(dirFromNeighbourToCurrentCell))
+                continue;
+
+            const uint32_t newDistance = current.first + BuildModes::stepWeight(cells[neighbourCellIdx].getCost(), diagonal);
+            if (inBuild && newDistance >= distance[neighbourCellIdx])
+                continue;
+
+            distance[neighbourCellIdx] = newDistance;
+            repaired.insert(neighbourCellIdx);
+            cells[neighbourCellIdx].setBuildId(layer, buildId);
+            cells[neighbourCellIdx].setDirection(layer, dirFromNeighbourToCurrentCell);
+            cellQueue.push({newDistance, neighbourCellIdx});
+
+            if (plane != nullptr)
+                plane[neighbourCellIdx] = newDistance;
+
+            FLOW_STATS(++stats.cellsEnqueued; stats.peakQueueDepth = std::max<uint64_t>(stats.peakQueueDepth, cellQueue.size()));
+        }
+    }
+}
+
+} // namespace flow
+
+#endif // field_repair_cpp
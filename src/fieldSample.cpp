@@ -0,0 +1,123 @@
+#include "field.hpp"
+
+#ifndef field_sample_cpp
+#define field_sample_cpp
+
+#include <algorithm>
+#include <stdexcept>
+#include "fieldCell.hpp"
+
+#define NULL_GUARD(i) if (i == nullptr)\
+                             throw std::runtime_error("NULL pointer exception")
+
+#define VALIDATE_LAYER(layer) if (layer >= layerCount())\
+                                  throw std::range_error("Layer out of range")
+
+namespace flow {
+
+/* Bilinear sampling.
+ *
+ * Cell (x, y) covers [x, x + 1) x [y, y + 1), so its direction is exact at
+ * (x + 0.5, y + 0.5). A position blends the 4 cells whose centers surround
+ * it, weighted by proximity. Walls and cells without a direction carry no
+ * vector, so they are left out and the remaining weights are scaled back to
+ * 1; the destination is a zero vector, so agents slow down as they reach it.
+ *
+ * Direction vectors are normalized by their number of non-zero components,
+ * and so is a blend of neighbouring directions (e.g. east and south blend to
+ * the south east vector). Positions outside the field sample the border
+ * cells.
+ */
+template <typename T, size_t S, typename C, typename G>
+template <typename F>
+void Field_t<T, S, C, G>::sampleAt (const uint8_t * base, size_t stride, F x, F y, F * vX, F * vY) const {
+    F cX = x - F(0.5);
+    F cY = y - F(0.5);
+
+    // Written so that NaN also clamps to the first cell
+    if (!(cX > F(0)))
+        cX = F(0);
+    if (!(cY > F(0)))
+        cY = F(0);
+    cX = std::min(cX, F(width - 1));
+    cY = std::min(cY, F(height - 1));
+
+    const size_t x0 = (size_t)cX;
+    const size_t y0 = (size_t)cY;
+    const size_t x1 = std::min<size_t>(x0 + 1, width - 1);
+    const size_t y1 = std::min<size_t>(y0 + 1, height - 1);
+    const F tX = cX - F(x0);
+    const F tY = cY - F(y0);
+
+    const size_t idx[4] = {vec2ToArrayIdx(x0, y0), vec2ToArrayIdx(x1, y0), vec2ToArrayIdx(x0, y1), vec2ToArrayIdx(x1, y1)};
+    const F weight[4] = {(1 - tX) * (1 - tY), tX * (1 - tY), (1 - tX) * tY, tX * tY};
+
+    F sumX = 0, sumY = 0, total = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        const auto dir = base[idx[i] * stride] & 0xF;
+        if (dir == Directions::STOP)
+            continue;
+
+        total += weight[i];
+        sumX += weight[i] * Directions::vectorX[dir];
+        sumY += weight[i] * Directions::vectorY[dir];
+    }
+
+    (*vX) = total > 0 ? sumX / total : 0;
+    (*vY) = total > 0 ? sumY / total : 0;
+}
+
+/// Sample an interpolated direction vector at a position
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::sampleDirection (size_t layer, float x, float y, float * vX, float * vY) {
+    sampleDirections(layer, 1, &x, &y, vX, vY);
+}
+
+/// Sample an interpolated direction vector at a position
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::sampleDirection (size_t layer, double x, double y, double * vX, double * vY) {
+    sampleDirections(layer, 1, &x, &y, vX, vY);
+}
+
+/// Sample interpolated direction vectors at `count` positions at once
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::sampleDirections (size_t layer, size_t count, const float * x, const float * y, float * vX, float * vY) {
+    VALIDATE_LAYER(layer);
+    NULL_GUARD(x);
+    NULL_GUARD(y);
+    NULL_GUARD(vX);
+    NULL_GUARD(vY);
+
+    FLOW_COUNT_QUERIES(layers[layer].directionQueries, count);
+
+    const uint8_t * base = cells.directionData(layer);
+    const size_t stride = cells.directionStride();
+
+    for (size_t i = 0; i < count; ++i)
+        sampleAt(base, stride, x[i], y[i], vX + i, vY + i);
+}
+
+/// Sample interpolated direction vectors at `count` positions at once
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::sampleDirections (size_t layer, size_t count, const double * x, const double * y, double * vX, double * vY) {
+    VALIDATE_LAYER(layer);
+    NULL_GUARD(x);
+    NULL_GUARD(y);
+    NULL_GUARD(vX);
+    NULL_GUARD(vY);
+
+    FLOW_COUNT_QUERIES(layers[layer].directionQueries, count);
+
+    const uint8_t * base = cells.directionData(layer);
+    const size_t stride = cells.directionStride();
+
+    for (size_t i = 0; i < count; ++i)
+        sampleAt(base, stride, x[i], y[i], vX + i, vY + i);
+}
+
+} // namespace flow
+
+#undef VALIDATE_LAYER
+#undef NULL_GUARD
+
+#endif // field_sample_cpp
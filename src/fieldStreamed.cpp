@@ -0,0 +1,83 @@
+#include "field.hpp"
+
+#ifndef field_streamed_cpp
+#define field_streamed_cpp
+
+#include <algorithm>
+#include "fieldCell.hpp"
+
+namespace flow {
+
+/* Breadth-first build of streamed storages (see TileFileCells).
+ *
+ * A FIFO frontier jumps from tile to tile around the wavefront, so once the
+ * tiles of the wavefront no longer fit in memory, nearly every cell would load
+ * a tile. This build expands one distance level at a time instead, sorted by
+ * storage index: with a tiled layout the cells of a tile are expanded together,
+ * and each tile of the wavefront is loaded at most once per level. Throughput
+ * then drops with the tiles loaded per level rather than per cell.
+ *
+ * Distances, reached cells and marked walls are those of the FIFO build.
+ * Where two routes are equally short, a cell may point along the other one.
+ */
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::buildStreamed (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace) {
+    FLOW_TRACE_EVENT(BUILD_BEGIN, layer);
+    FLOW_STATS(StatsTimer timer);
+    FLOW_STATS(BuildStats& stats = beginStats(layer, BuildModes::BREADTH_FIRST, false));
+
+    const uint8_t buildId = nextBuildId(layer);
+    uint32_t * distance = resetDistances(layer);
+
+    auto& level = workspace.level;
+    auto& nextLevel = workspace.nextLevel;
+    level.clear();
+
+    // Load POIs to the first level and mark them as the destination
+    for (auto point : poi) {
+        const auto cellIdx = vec2ToArrayIdx(point);
+        level.push_back(cellIdx);
+        cells[cellIdx].setDirection(layer, Directions::DEST);
+        cells[cellIdx].setBuildId(layer, buildId);
+
+        if (distance != nullptr)
+            distance[cellIdx] = 0;
+    }
+
+    FLOW_STATS(stats.cellsEnqueued = stats.peakQueueDepth = level.size(); stats.seedMs = timer.lapMs());
+    FLOW_TRACE_EVENT(SEED_END, layer);
+
+    const Direction_t * directions = Directions::expansionOrder;
+
+    for (uint32_t depth = 1; !level.empty(); ++depth) {
+        std::sort(level.begin(), level.end());
+        nextLevel.clear();
+
+        for (const auto cellIdx : level) {
+            FLOW_STATS(++stats.cellsVisited);
+
+            for (auto i = 0; directions[i] != Directions::STOP; ++i) {
+                const auto neighbourCellIdx = expandNeighbour(layer, buildId, cellIdx, directions[i]);
+                if (neighbourCellIdx != (size_t)(-1)) {
+                    nextLevel.push_back(neighbourCellIdx);
+                    FLOW_STATS(++stats.cellsEnqueued);
+
+                    if (distance != nullptr)
+                        distance[neighbourCellIdx] = depth;
+                }
+            }
+        }
+
+        FLOW_STATS(stats.peakQueueDepth = std::max<uint64_t>(stats.peakQueueDepth, nextLevel.size()));
+        level.swap(nextLevel);
+    }
+
+    FLOW_STATS(stats.expandMs = timer.lapMs());
+    finishBuild(layer, buildId, BuildModes::BREADTH_FIRST);
+    FLOW_STATS(stats.totalMs = timer.totalMs());
+    FLOW_TRACE_EVENT(BUILD_END, layer);
+}
+
+} // namespace flow
+
+#endif // field_streamed_cpp
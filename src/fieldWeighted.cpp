@@ -0,0 +1,176 @@
+#include "field.hpp"
+
+#ifndef field_weighted_cpp
+#define field_weighted_cpp
+
+#include <stdexcept>
+#include <vector>
+#include "fieldCell.hpp"
+
+namespace flow {
+
+/* Weighted build (Dial's algorithm).
+ *
+ * Edge weights are small integers (cost * CARDINAL_WEIGHT or cost *
+ * DIAGONAL_WEIGHT), so instead of a heap the integration field uses a circular
+ * array of buckets, one per distance value modulo (largest weight + 1). Every
+ * pending cell is closer than the largest weight to the bucket being scanned,
+ * so buckets never hold two distances at once. A cell's direction is updated
+ * whenever its distance improves, so it ends up pointing to the neighbour on
+ * its shortest route.
+ *
+ * The queue and the position of the scan live in the workspace, so the build
+ * can stop after any cell and resume later (beginBuild and continueBuild). A
+ * cell only points to a cell taken from the queue before it, so routes never
+ * loop, even when costs change between two slices.
+ */
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::buildWeighted (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace) {
+    beginBuild(layer, poi, workspace);
+    continueBuild(layer, 0, workspace);
+}
+
+template <typename T, size_t S, typename C, typename G>
+void Field_t<T, S, C, G>::beginBuild (size_t layer, const PointOfInterests& poi, BuildWorkspace& workspace) {
+    if (C::streamed)
+        throw std::invalid_argument("Streamed fields only build BREADTH_FIRST layers");
+
+    FLOW_TRACE_EVENT(BUILD_BEGIN, layer);
+    FLOW_STATS(StatsTimer timer);
+    FLOW_STATS(BuildStats& stats = beginStats(layer, BuildModes::WEIGHTED, false));
+
+    auto& progress = workspace.weighted;
+    progress = WeightedProgress();
+    progress.buildId = nextBuildId(layer);
+
+    const size_t bucketCount = BuildModes::stepWeight(0xFF, true) + 1;
+
+    auto& distance = workspace.distances;
+    distance.assign(cells.size(), UNREACHABLE_DISTANCE);
+
+    // Buckets are empty after a build, unless it threw or was abandoned
+    auto& buckets = workspace.buckets;
+    buckets.resize(bucketCount);
+    for (auto& bucket : buckets)
+        bucket.clear();
+
+    // Load POIs to the first bucket and mark them as the destination
+    for (auto point : poi) {
+        const auto cellIdx = vec2ToArrayIdx(point);
+        cells[cellIdx].setDirection(layer, Directions::DEST);
+        cells[cellIdx].setBuildId(layer, progress.buildId);
+
+        if (distance[cellIdx] != 0) {
+            distance[cellIdx] = 0;
+            buckets[0].push_back(cellIdx);
+            ++progress.pending;
+        }
+    }
+
+    // Set last, so a build whose seeding threw is not continued
+    progress.layer = layer;
+
+    FLOW_STATS(stats.cellsEnqueued = stats.peakQueueDepth = progress.pending; stats.seedMs = timer.lapMs());
+    FLOW_TRACE_EVENT(SEED_END, layer);
+}
+
+template <typename T, size_t S, typename C, typename G>
+bool Field_t<T, S, C, G>::continueBuild (size_t layer, size_t maxCells, BuildWorkspace& workspace) {
+    auto& progress = workspace.weighted;
+    if (progress.layer != layer)
+        throw std::logic_error("No build of the layer is under way in the workspace");
+
+    FLOW_STATS(StatsTimer timer);
+    FLOW_STATS(BuildStats& stats = layers[layer].stats);
+
+    const uint8_t buildId = progress.buildId;
+    const size_t bucketCount = BuildModes::stepWeight(0xFF, true) + 1;
+    const Direction_t * directions = Directions::expansionOrder;
+
+    auto& distance = workspace.distances;
+    auto& buckets = workspace.buckets;
+    size_t taken = 0;
+
+    for (; progress.pending > 0; ++progress.current) {
+        auto& bucket = buckets[progress.current % bucketCount];
+        const uint32_t current = progress.current;
+
+        // Zero cost cells are appended to the bucket being scanned, so don't iterate with references
+        while (progress.position < bucket.size()) {
+            if (taken == maxCells && maxCells != 0) {
+                FLOW_STATS(stats.expandMs += timer.lapMs());
+                return false;
+            }
+
+            const auto cellIdx = bucket[progress.position++];
+            --progress.pending;
+            ++taken;
+
+            // Skip entries whose distance was improved after they were queued
+            if (distance[cellIdx] != current)
+                continue;
+
+            FLOW_STATS(++stats.cellsVisited);
+
+            for (auto i = 0; directions[i] != Directions::STOP; ++i) {
+                const auto neighbourCellIdx = moveIndexByDirection(cellIdx, directions[i]);
+                if (neighbourCellIdx == (size_t)(-1))
+                    continue;
+
+                // Skip settled cells
+                if (distance[neighbourCellIdx] <= current)
+                    continue;
+
+                // Skip cell if wall. Also mark it as a wall
+                if (cells[neighbourCellIdx].isWall()) {
+                    if (cells[neighbourCellIdx].getBuildId(layer) != buildId) {
+                        cells[neighbourCellIdx].setBuildId(layer, buildId);
+                        cells[neighbourCellIdx].markDirAsWall(layer);
+                        FLOW_STATS(++stats.wallsMarked);
+                    }
+                    continue;
+                }
+
+                // Skip diagonal if diagonal direction is not allowed
+                const bool diagonal = Directions::isDiagonal(directions[i]);
+                if (diagonal && !cells[neighbourCellIdx].getAllowDiagonal())
+                    continue;
+
+                // Check if the direction to the current cell is valid from the neighbour or not
+                auto dirFromNeighbourToCurrentCell = Directions::negateDir(directions[i]);
+                if (!cells[cellIdx].canEnterFrom(dirFromNeighbourToCurrentCell))
+                    continue;
+
+                const uint32_t newDistance = current + BuildModes::stepWeight(cells[neighbourCellIdx].getCost(), diagonal);
+                if (newDistance >= distance[neighbourCellIdx])
+                    continue;
+
+                distance[neighbourCellIdx] = newDistance;
+                cells[neighbourCellIdx].setBuildId(layer, buildId);
+                cells[neighbourCellIdx].setDirection(layer, dirFromNeighbourToCurrentCell);
+                buckets[newDistance % bucketCount].push_back(neighbourCellIdx);
+                ++progress.pending;
+                FLOW_STATS(++stats.cellsEnqueued; stats.peakQueueDepth = std::max<uint64_t>(stats.peakQueueDepth, progress.pending));
+            }
+        }
+
+        bucket.clear();
+        progress.position = 0;
+    }
+
+    progress.layer = (size_t)(-1);
+
+    // The integration field is the distance plane. The previous plane is kept by the workspace for the next build
+    if (!layers[layer].distances.empty())
+        layers[layer].distances.swap(distance);
+
+    FLOW_STATS(stats.expandMs += timer.lapMs());
+    finishBuild(layer, buildId, BuildModes::WEIGHTED);
+    FLOW_STATS(stats.totalMs = stats.seedMs + stats.expandMs + timer.lapMs());
+    FLOW_TRACE_EVENT(BUILD_END, layer);
+    return true;
+}
+
+} // namespace flow
+
+#endif // field_weighted_cpp
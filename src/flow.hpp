@@ -2,3 +2,12 @@
 
 #include "field.hpp"
 #include "fieldCell.hpp"
+#include "planarCells.hpp"
+#include "sectorField.hpp"
+#include "fieldFile.hpp"
+#include "layerCache.hpp"
+#include "asyncLayer.hpp"
+#include "crowd.hpp"
+#include "congestion.hpp"
+#include "buildScheduler.hpp"
+#include "instrumentation.hpp"
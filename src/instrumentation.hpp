@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <atomic>
+#include <chrono>
+
+#include "buildModes.hpp"
+
+/* Instrumentation switches. Define them before including flow.hpp (or with -D):
+ *
+ * FLOW_BUILD_STATS:    Collect a BuildStats record for every build and repair.
+ * FLOW_TRACE:          Call the trace hook (see Trace::setHook) at the start
+ *                      and end of every build phase.
+ * FLOW_QUERY_COUNTERS: Count direction and next cell queries per layer.
+ *
+ * When a switch is off, its instrumentation compiles to nothing. The accessors
+ * stay available and report zeros.
+ */
+#ifdef FLOW_BUILD_STATS
+#define FLOW_STATS(...) __VA_ARGS__
+#else
+#define FLOW_STATS(...)
+#endif
+
+#ifdef FLOW_TRACE
+#define FLOW_TRACE_EVENT(event, layer) flow::Trace::emit(flow::Trace::event, layer)
+#else
+#define FLOW_TRACE_EVENT(event, layer)
+#endif
+
+#ifdef FLOW_QUERY_COUNTERS
+#define FLOW_COUNT_QUERIES(counter, count) (counter).fetch_add(count, std::memory_order_relaxed)
+#else
+#define FLOW_COUNT_QUERIES(counter, count)
+#endif
+
+namespace flow {
+    /// Work done by the latest build or repair of a layer
+    struct BuildStats {
+        BuildModes::BuildMode_t mode;
+        bool repair;                // Produced by updateCells
+
+        uint64_t cellsVisited;      // Cells taken from the queue and expanded
+        uint64_t cellsEnqueued;     // Cells routed and queued, including points of interest and repair seeds
+        uint64_t peakQueueDepth;    // Largest number of queued cells (BFS queue or frontier, weighted buckets)
+        uint64_t wallsMarked;       // Walls reached and marked
+        uint64_t unreachableCells;  // Passable cells left without a route. Full builds only
+
+        double seedMs;              // Build ID, points of interest, and for repairs the invalidation and seeding
+        double expandMs;            // Queue expansion
+        double totalMs;
+    };
+
+    /// Direction queries of a layer, counted with FLOW_QUERY_COUNTERS
+    struct QueryCounts {
+        uint64_t directions;        // getDirection and getDirections, per coordinate
+        uint64_t nextCells;         // getNextCell and getNextCells, per coordinate
+    };
+
+    /// Wall clock laps of a build, in milliseconds
+    class StatsTimer {
+    public:
+        StatsTimer () :
+            start(Clock::now()),
+            last(start)
+        {}
+
+        /// Time since the previous lap (or the start)
+        double lapMs () {
+            const auto now = Clock::now();
+            const double ms = std::chrono::duration<double, std::milli>(now - last).count();
+            last = now;
+            return ms;
+        }
+
+        double totalMs () const {
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        Clock::time_point start;
+        Clock::time_point last;
+    };
+
+    namespace Trace {
+        typedef enum Event_t : uint8_t {
+            BUILD_BEGIN  = 0,
+            SEED_END     = 1,   // Points of interest (or repair seeds) are queued
+            BUILD_END    = 2,
+            REPAIR_BEGIN = 3,
+            REPAIR_END   = 4,
+        } Event_t;
+
+        /// Called from the building thread. `userData` is the pointer given to setHook
+        typedef void (*Hook) (Event_t event, size_t layer, void * userData);
+
+        struct HookSlot {
+            std::atomic<Hook> hook;
+            std::atomic<void *> userData;
+        };
+
+        inline HookSlot& hookSlot () {
+            static HookSlot slot = {{nullptr}, {nullptr}};
+            return slot;
+        }
+
+        /// Install the trace hook, or remove it with nullptr. Only called when compiled with FLOW_TRACE
+        inline void setHook (Hook hook, void * userData = nullptr) {
+            hookSlot().userData.store(userData, std::memory_order_relaxed);
+            hookSlot().hook.store(hook, std::memory_order_release);
+        }
+
+        inline void emit (Event_t event, size_t layer) {
+            const Hook hook = hookSlot().hook.load(std::memory_order_acquire);
+            if (hook != nullptr)
+                hook(event, layer, hookSlot().userData.load(std::memory_order_relaxed));
+        }
+    }
+}
@@ -0,0 +1,154 @@
+#include "layerCache.hpp"
+
+#ifndef layer_cache_cpp
+#define layer_cache_cpp
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+namespace flow {
+
+template <typename F>
+LayerCache<F>::LayerCache (F& _field, size_t _firstLayer, size_t _layerCount) :
+    field(_field),
+    firstLayer(_firstLayer),
+    layerCount(_layerCount),
+    recent(),
+    entries(),
+    freeLayers(),
+    hitCount(0),
+    missCount(0),
+    evictionCount(0)
+{
+    if (_firstLayer + _layerCount > _field.layerCount())
+        throw std::range_error("Layer out of range");
+
+    clear();
+}
+
+template <typename F>
+size_t LayerCache<F>::request (const PointOfInterests& poi, BuildModes::BuildMode_t mode) {
+    Key key = makeKey(poi, mode);
+
+    size_t layer = lookup(key);
+    if (layer != (size_t)(-1))
+        return layer;
+
+    // Built from the sorted goals, so the layer does not depend on the order of the first request
+    layer = insert(std::move(key));
+    try {
+        field.addPointOfInterest(layer, recent.front().key.goals, mode);
+    } catch (...) {
+        discardFront();
+        throw;
+    }
+
+    return layer;
+}
+
+template <typename F>
+size_t LayerCache<F>::request (const PointOfInterests& poi, ThreadPool& pool) {
+    // The parallel build produces the same layer as the serial one, so both share the key
+    Key key = makeKey(poi, BuildModes::BREADTH_FIRST);
+
+    size_t layer = lookup(key);
+    if (layer != (size_t)(-1))
+        return layer;
+
+    layer = insert(std::move(key));
+    try {
+        field.addPointOfInterest(layer, recent.front().key.goals, pool);
+    } catch (...) {
+        discardFront();
+        throw;
+    }
+
+    return layer;
+}
+
+template <typename F>
+size_t LayerCache<F>::find (const PointOfInterests& poi, BuildModes::BuildMode_t mode) const {
+    const auto entry = entries.find(makeKey(poi, mode));
+    return entry != entries.end() ? entry->second->layer : (size_t)(-1);
+}
+
+template <typename F>
+void LayerCache<F>::clear () {
+    recent.clear();
+    entries.clear();
+
+    // Handed out from the back, lowest layer first
+    freeLayers.clear();
+    for (size_t i = layerCount; i > 0; --i)
+        freeLayers.push_back(firstLayer + i - 1);
+}
+
+template <typename F>
+size_t LayerCache<F>::KeyHash::operator() (const Key& key) const {
+    size_t hash = std::hash<size_t>()(key.mode);
+    for (const auto& goal : key.goals) {
+        const size_t value = std::hash<uint64_t>()(((uint64_t)goal[1] << 32) | (uint64_t)goal[0]);
+        hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+
+    return hash;
+}
+
+template <typename F>
+typename LayerCache<F>::Key LayerCache<F>::makeKey (const PointOfInterests& poi, BuildModes::BuildMode_t mode) {
+    Key key = {mode, poi};
+
+    std::sort(key.goals.begin(), key.goals.end(), [](const Vec2& a, const Vec2& b) {
+        return a[1] != b[1] ? a[1] < b[1] : a[0] < b[0];
+    });
+    key.goals.erase(std::unique(key.goals.begin(), key.goals.end()), key.goals.end());
+
+    return key;
+}
+
+template <typename F>
+size_t LayerCache<F>::lookup (const Key& key) {
+    const auto entry = entries.find(key);
+    if (entry == entries.end()) {
+        ++missCount;
+        return -1;
+    }
+
+    ++hitCount;
+    recent.splice(recent.begin(), recent, entry->second);
+    return entry->second->layer;
+}
+
+template <typename F>
+size_t LayerCache<F>::insert (Key&& key) {
+    if (layerCount == 0)
+        throw std::range_error("Layer cache has no layers");
+
+    size_t layer;
+    if (!freeLayers.empty()) {
+        layer = freeLayers.back();
+        freeLayers.pop_back();
+    } else {
+        layer = recent.back().layer;
+        entries.erase(recent.back().key);
+        recent.pop_back();
+        ++evictionCount;
+    }
+
+    recent.push_front({std::move(key), layer});
+    entries[recent.front().key] = recent.begin();
+    return layer;
+}
+
+template <typename F>
+void LayerCache<F>::discardFront () {
+    entries.erase(recent.front().key);
+    freeLayers.push_back(recent.front().layer);
+    recent.pop_front();
+}
+
+} // namespace flow
+
+#endif // layer_cache_cpp
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "buildModes.hpp"
+#include "field.hpp"
+#include "threadPool.hpp"
+
+namespace flow {
+    /* Least recently used cache of flow fields, keyed by goal set.
+     *
+     * The cache owns a range of layers of a field and hands them out per set of
+     * points of interest. The same goals (in any order, duplicates ignored) and
+     * build mode map to the same layer, so repeated requests are a hash lookup.
+     * A request for new goals builds them into a free layer, or into the layer
+     * that was requested the longest time ago.
+     *
+     * A returned layer index stays valid until a request evicts it, so request
+     * the goals again (e.g. once per tick) instead of keeping the index around.
+     * Cached layers follow the map as long as it is changed through updateCells.
+     *
+     * Combined with a PooledField, the number of layers (and so the memory per
+     * cell) is chosen at runtime, e.g. from the number of goals active at once.
+     */
+    template <typename FieldType>
+    class LayerCache {
+    public:
+        using Vec2 = typename FieldType::Vec2;
+        using PointOfInterests = typename FieldType::PointOfInterests;
+
+    public:
+        /// Cache every layer of `_field`
+        explicit LayerCache (FieldType& _field) :
+            LayerCache(_field, 0, _field.layerCount())
+        {}
+
+        /// Cache the layers [firstLayer, firstLayer + layerCount) of `_field`. The other layers can still be used by hand
+        LayerCache (FieldType& _field, size_t firstLayer, size_t layerCount);
+
+        LayerCache (const LayerCache&) = delete;
+        LayerCache& operator= (const LayerCache&) = delete;
+
+        /// Layer holding the flow field towards `poi`. Built on a miss, and not cached if the build throws
+        size_t request (const PointOfInterests& poi, BuildModes::BuildMode_t mode = BuildModes::BREADTH_FIRST);
+
+        /// Same as request, but a miss is built across the workers of `pool`
+        size_t request (const PointOfInterests& poi, ThreadPool& pool);
+
+        /// Layer holding the flow field towards `poi` without building it or refreshing it. (size_t)(-1) if not cached
+        size_t find (const PointOfInterests& poi, BuildModes::BuildMode_t mode = BuildModes::BREADTH_FIRST) const;
+
+        /// Forget every goal set, e.g. after the map was reloaded instead of repaired
+        void clear ();
+
+        /// Number of cached goal sets
+        size_t size () const {
+            return recent.size();
+        }
+
+        /// Number of layers owned by the cache
+        size_t capacity () const {
+            return layerCount;
+        }
+
+        uint64_t hits () const {
+            return hitCount;
+        }
+
+        uint64_t misses () const {
+            return missCount;
+        }
+
+        uint64_t evictions () const {
+            return evictionCount;
+        }
+
+    private:
+        /// Goals sorted by (y, x) without duplicates, and the build mode
+        struct Key {
+            BuildModes::BuildMode_t mode;
+            PointOfInterests goals;
+
+            bool operator== (const Key& other) const {
+                return mode == other.mode && goals == other.goals;
+            }
+        };
+
+        struct KeyHash {
+            size_t operator() (const Key& key) const;
+        };
+
+        struct Entry {
+            Key key;
+            size_t layer;
+        };
+
+        FieldType& field;
+        size_t firstLayer;
+        size_t layerCount;
+
+        std::list<Entry> recent; // Most recently requested first
+        std::unordered_map<Key, typename std::list<Entry>::iterator, KeyHash> entries;
+        std::vector<size_t> freeLayers;
+
+        uint64_t hitCount;
+        uint64_t missCount;
+        uint64_t evictionCount;
+
+    private:
+        static Key makeKey (const PointOfInterests& poi, BuildModes::BuildMode_t mode);
+
+        /// Layer of a cached key, moved to the front of the LRU order. (size_t)(-1) on a miss
+        size_t lookup (const Key& key);
+
+        /// Assign a layer to a new key, evicting the least recently used one if none is free
+        size_t insert (Key&& key);
+
+        /// Forget the most recently inserted key, whose build threw. Its layer is free again
+        void discardFront ();
+    };
+}
+
+#include "layerCache.cpp"
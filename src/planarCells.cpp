@@ -0,0 +1,69 @@
+#include "planarCells.hpp"
+
+#ifndef planar_cells_cpp
+#define planar_cells_cpp
+
+#include <stdexcept>
+
+#include "cellChecks.hpp"
+
+#define setDirectionMap(existing, newVal) ((existing & 0xF0) + (newVal & 0x0F))
+
+namespace flow {
+
+template <size_t maxNavLayer>
+Direction_t PlanarCell<maxNavLayer>::getDirection (size_t layer) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    return direction(layer) & 0x0F;
+}
+
+template <size_t maxNavLayer>
+void PlanarCell<maxNavLayer>::setDirection (size_t layer, Direction_t newDirection) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    direction(layer) = setDirectionMap(direction(layer), newDirection);
+}
+
+template <size_t maxNavLayer>
+void PlanarCell<maxNavLayer>::markDirAsWall (size_t layer) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    direction(layer) = setDirectionMap(direction(layer), Directions::WALL);
+}
+
+template <size_t maxNavLayer>
+void PlanarCell<maxNavLayer>::markDirAsStop (size_t layer) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    direction(layer) = setDirectionMap(direction(layer), Directions::STOP);
+}
+
+template <size_t maxNavLayer>
+void PlanarCell<maxNavLayer>::setBuildId (size_t layer, uint8_t buildId) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    direction(layer) = (buildId << 4) + (direction(layer) & 0xF);
+}
+
+template <size_t maxNavLayer>
+uint8_t PlanarCell<maxNavLayer>::getBuildId (size_t layer) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    return (direction(layer) >> 4);
+}
+
+template <size_t maxNavLayer>
+bool PlanarCell<maxNavLayer>::canEnterFrom (Direction_t dir) {
+    auto entryWhitelist = getEntryDir();
+
+    const bool passFilter = (entryWhitelist & dir) != 0;
+    const bool passInvFilter = ((~entryWhitelist) & dir) == 0;
+    return (passFilter && passInvFilter);
+}
+
+} // namespace flow
+
+#undef setDirectionMap
+
+#endif // planar_cells_cpp
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+#include "directions.hpp"
+
+namespace flow {
+    /// Layer count of a storage whose number of layers is given at runtime, see PlanarCells
+    static const size_t DYNAMIC_LAYERS = 0;
+
+    template <size_t maxNavLayer>
+    class PlanarCells;
+
+    template <size_t maxNavLayer>
+    class PlanarCellPointer;
+
+    /* Handle to a single cell of a PlanarCells storage. Offers the same
+     * interface as FieldCell, but reads and writes the storage planes.
+     */
+    template <size_t maxNavLayer>
+    class PlanarCell {
+        template <typename T, size_t S, typename C, typename G>
+        friend class Field_t;
+
+        template <typename T, size_t L, size_t Size>
+        friend class SectorField_t;
+
+        friend class PlanarCells<maxNavLayer>;
+        friend class PlanarCellPointer<maxNavLayer>;
+
+    public:
+        size_t getMaxNavLayer () {
+            return storage->layerCount();
+        }
+
+        Direction_t getDirection (size_t layer);
+
+        void setEntryDir (Direction_t direction) {
+            access() = (access() & 0xF0) | direction;
+        }
+
+        Direction_t getEntryDir () {
+            return access() & 0xF;
+        }
+
+        void setAllowDiagonal (bool allowDiag) {
+            access() = (access() & ~0x10) | (allowDiag ? 0x10 : 0);
+        }
+
+        bool getAllowDiagonal () {
+            return (access() & 0x10) != 0;
+        }
+
+        bool isWall () {
+            return getEntryDir() == Directions::WALL;
+        }
+
+        /// Cost of moving out of this cell, used by the weighted build mode. 1 (default) to 255
+        void setCost (uint8_t cost) {
+            storage->costPlane[idx] = cost;
+        }
+
+        uint8_t getCost () {
+            return storage->costPlane[idx];
+        }
+
+    private:
+        PlanarCells<maxNavLayer> * storage;
+        size_t idx;
+
+    private:
+        PlanarCell (PlanarCells<maxNavLayer> * _storage, size_t _idx) :
+            storage(_storage),
+            idx(_idx)
+        {}
+
+        inline uint8_t& access () {
+            return storage->accessPlane[idx];
+        }
+
+        inline uint8_t& direction (size_t layer) {
+            return storage->directionPlanes[layer * storage->cellCount + idx];
+        }
+
+        void setDirection (size_t layer, Direction_t direction);
+        void markDirAsWall (size_t layer);
+        void markDirAsStop (size_t layer);
+        bool canEnterFrom (Direction_t dir);
+
+        void setBuildId (size_t layer, uint8_t buildId);
+        uint8_t getBuildId (size_t layer);
+
+        inline void setCellAsDest (size_t layer) {
+            markDirAsStop(layer);
+        }
+
+        inline size_t maxLayer () {
+            return storage->layerCount();
+        }
+    };
+
+    /// Pointer-like wrapper around a PlanarCell, used by the field iterator
+    template <size_t maxNavLayer>
+    class PlanarCellPointer {
+    public:
+        PlanarCellPointer (PlanarCells<maxNavLayer> * storage, size_t idx) :
+            cell(storage, idx)
+        {}
+
+        PlanarCell<maxNavLayer>& operator* () const { return cell; }
+        PlanarCell<maxNavLayer> * operator-> () const { return &cell; }
+
+        PlanarCellPointer& operator++ () { ++cell.idx; return *this; }
+
+        bool operator== (const PlanarCellPointer& other) const { return cell.idx == other.cell.idx && cell.storage == other.cell.storage; };
+        bool operator!= (const PlanarCellPointer& other) const { return !(*this == other); };
+
+    private:
+        mutable PlanarCell<maxNavLayer> cell;
+    };
+
+    /* Structure-of-arrays cell storage.
+     *
+     * The access data of every cell lives in one contiguous byte plane, using the
+     * same bit allocation as FieldCell (0-3 entry direction, 4 diagonal access),
+     * followed by a plane of traversal costs. Each layer has its own contiguous
+     * plane holding the direction in the low nibble and the build ID in the high
+     * nibble. A cell therefore costs 2 + maxNavLayer bytes, and building or
+     * querying a layer only touches the access plane and that layer's plane.
+     *
+     * With maxNavLayer = DYNAMIC_LAYERS, the number of layers is a constructor
+     * argument instead of a template argument.
+     */
+    template <size_t maxNavLayer>
+    class PlanarCells {
+        friend class PlanarCell<maxNavLayer>;
+
+    public:
+        using value_type = PlanarCell<maxNavLayer>;
+        using reference  = value_type;
+        using pointer    = PlanarCellPointer<maxNavLayer>;
+
+        /// Every cell is in memory, see TileFileCells
+        static const bool streamed = false;
+
+    public:
+        explicit PlanarCells (size_t _cellCount, size_t _layerCount = maxNavLayer) :
+            cellCount(_cellCount),
+            layers(_layerCount),
+            planes(planeBytes(_cellCount, _layerCount), 0)
+        {
+            usePlanes(planes.data());
+            std::fill(costPlane, costPlane + _cellCount, 1);
+        }
+
+        /// Cells stored in external memory of planeBytes(_cellCount, _layerCount) bytes laid out like the owned planes (e.g. a memory mapped file). The memory must outlive the storage
+        PlanarCells (size_t _cellCount, uint8_t * externalPlanes, size_t _layerCount = maxNavLayer) :
+            cellCount(_cellCount),
+            layers(_layerCount),
+            planes()
+        {
+            usePlanes(externalPlanes);
+        }
+
+        PlanarCells (const PlanarCells&) = delete;
+        PlanarCells& operator= (const PlanarCells&) = delete;
+
+        inline reference operator[] (size_t idx) {
+            return value_type(this, idx);
+        }
+
+        inline value_type operator[] (size_t idx) const {
+            return value_type(const_cast<PlanarCells *>(this), idx);
+        }
+
+        /// Pointer to a cell, used by the field iterator
+        inline pointer address (size_t idx) {
+            return pointer(this, idx);
+        }
+
+        /// Address of the direction byte of the first cell. Consecutive cells are directionStride() bytes apart
+        inline const uint8_t * directionData (size_t layer) const {
+            return directionPlanes + layer * cellCount;
+        }
+
+        inline size_t directionStride () const {
+            return 1;
+        }
+
+        inline size_t size () const {
+            return cellCount;
+        }
+
+        /// Constant unless the layer count is dynamic, so layer checks compile to an immediate compare
+        inline size_t layerCount () const {
+            return maxNavLayer != DYNAMIC_LAYERS ? maxNavLayer : layers;
+        }
+
+        /// Bytes used by the cells
+        inline size_t memoryUsage () const {
+            return planeBytes(cellCount, layerCount());
+        }
+
+        /// Size of the planes of `cellCount` cells: access, cost and one direction plane per layer, followed by the padding
+        static size_t planeBytes (size_t cellCount, size_t layerCount = maxNavLayer) {
+            return cellCount * (2 + layerCount) + planePadding;
+        }
+
+        /// Start of the planes, in the layout described by planeBytes
+        inline const uint8_t * planeData () const {
+            return accessPlane;
+        }
+
+        /// Set the access data of `count` cells from `first` to `in[i]`, or to `lookup[in[i]]` with a lookup table
+        void writeAccess (size_t first, size_t count, const uint8_t * in, const uint8_t * lookup) {
+            uint8_t * out = accessPlane + first;
+            if (lookup == nullptr) {
+                for (size_t i = 0; i < count; ++i)
+                    out[i] = in[i] & ACCESS_MASK;
+            } else {
+                for (size_t i = 0; i < count; ++i)
+                    out[i] = lookup[in[i]] & ACCESS_MASK;
+            }
+        }
+
+        void readAccess (size_t first, size_t count, uint8_t * out) const {
+            std::copy(accessPlane + first, accessPlane + first + count, out);
+        }
+
+        void writeCosts (size_t first, size_t count, const uint8_t * in) {
+            std::copy(in, in + count, costPlane + first);
+        }
+
+        void readCosts (size_t first, size_t count, uint8_t * out) const {
+            std::copy(costPlane + first, costPlane + first + count, out);
+        }
+
+        /// Reset the build ID of every cell of a layer to 0, see Field_t::nextBuildId
+        void clearBuildIds (size_t layer) {
+            uint8_t * plane = directionPlanes + layer * cellCount;
+            for (size_t i = 0; i < cellCount; ++i)
+                plane[i] &= 0x0F;
+        }
+
+    private:
+        /// Trailing bytes so a 32 bit load of the last cell's byte stays in bounds
+        static const size_t planePadding = 3;
+
+        size_t cellCount;
+        size_t layers;
+        std::vector<uint8_t> planes;
+
+        uint8_t * accessPlane;
+        uint8_t * costPlane;
+        uint8_t * directionPlanes; // Plane of layer l starts at directionPlanes + l * cellCount
+
+    private:
+        void usePlanes (uint8_t * base) {
+            accessPlane = base;
+            costPlane = base + cellCount;
+            directionPlanes = base + cellCount * 2;
+        }
+    };
+}
+
+#include "planarCells.cpp"
@@ -0,0 +1,578 @@
+#include "sectorField.hpp"
+
+#ifndef sector_field_cpp
+#define sector_field_cpp
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <queue>
+#include <set>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#define NULL_GUARD(i) if (i == nullptr)\
+                             throw std::runtime_error("NULL pointer exception")
+
+namespace flow {
+
+static const uint32_t sectorUnreachable = (uint32_t)(-1);
+
+template <typename T, size_t L, size_t Size>
+SectorField_t<T, L, Size> * SectorField_t<T, L, Size>::addPointOfInterest (size_t layer, const PointOfInterests& poi) {
+    if (layer >= L)
+        throw std::range_error("Layer out of range");
+
+    if (portalsDirty)
+        buildPortals();
+
+    layers[layer].poi = poi;
+    searchPortals(layer);
+
+    return this;
+}
+
+template <typename T, size_t L, size_t Size>
+SectorField_t<T, L, Size> * SectorField_t<T, L, Size>::updateCells (const std::vector<Vec2>& changedCells) {
+    if (portalsDirty)
+        return this;
+
+    std::set<size_t> changedSectors;
+    for (auto point : changedCells)
+        changedSectors.insert(sectorOf(point[0], point[1]));
+
+    // A sector's cells sit on its own borders, on the east border of its west neighbours and on the south border of its north neighbour
+    std::set<std::pair<size_t, Direction_t>> borders;
+    for (auto sector : changedSectors) {
+        const size_t sx = sector % sectorsX;
+        const size_t sy = sector / sectorsX;
+
+        borders.insert(std::make_pair(sector, Directions::EAST));
+        borders.insert(std::make_pair(sector, Directions::SOUTH));
+        if (sy > 0)
+            borders.insert(std::make_pair(sector - sectorsX, Directions::SOUTH));
+
+        if (sx > 0) {
+            borders.insert(std::make_pair(sector - 1, Directions::EAST));
+            if (sy > 0)
+                borders.insert(std::make_pair(sector - sectorsX - 1, Directions::EAST));
+            if (sy + 1 < sectorsY)
+                borders.insert(std::make_pair(sector + sectorsX - 1, Directions::EAST));
+        }
+    }
+
+    std::set<size_t> touchedSectors(changedSectors);
+    for (const auto& border : borders)
+        buildBorder(border.first, border.second, touchedSectors);
+
+    for (auto sector : touchedSectors)
+        buildSectorEdges(sector);
+
+    for (size_t layer = 0; layer < L; ++layer)
+        if (!layers[layer].portalDistance.empty())
+            searchPortals(layer);
+
+    return this;
+}
+
+template <typename T, size_t L, size_t Size>
+Direction_t SectorField_t<T, L, Size>::getDirection (size_t layer, T x, T y) {
+    if (layer >= L)
+        throw std::range_error("Layer out of range");
+
+    const size_t sector = sectorOf(x, y);
+    if (!layers[layer].portalDistance.empty() && !layers[layer].sectorBuilt[sector])
+        buildSector(layer, sector);
+
+    return field.getDirection(layer, x, y);
+}
+
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::getDirection (size_t layer, T x, T y, float * vX, float * vY) {
+    NULL_GUARD(vX);
+    NULL_GUARD(vY);
+
+    const auto dir = getDirection(layer, x, y);
+    (*vX) = Directions::vectorX[dir];
+    (*vY) = Directions::vectorY[dir];
+}
+
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::getNextCell (size_t layer, T x, T y, T * nX, T * nY) {
+    NULL_GUARD(nX);
+    NULL_GUARD(nY);
+
+    const auto dir = getDirection(layer, x, y);
+    (*nX) = x + Directions::stepX[dir];
+    (*nY) = y + Directions::stepY[dir];
+}
+
+/// Same rule as the layer build: `fromIdx` is passable, may move diagonally if needed, and `toIdx` accepts the direction
+template <typename T, size_t L, size_t Size>
+bool SectorField_t<T, L, Size>::canMove (size_t fromIdx, size_t toIdx, Direction_t dir) {
+    if (field.cells[fromIdx].isWall())
+        return false;
+
+    if (Directions::isDiagonal(dir) && !field.cells[fromIdx].getAllowDiagonal())
+        return false;
+
+    return field.cells[toIdx].canEnterFrom(dir);
+}
+
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::sectorPortals (size_t sector, std::vector<size_t>& exits, std::vector<size_t>& entries) {
+    const size_t sx = sector % sectorsX;
+    const size_t sy = sector / sectorsX;
+    const size_t none = (size_t)(-1);
+
+    // East borders of the sector and of its west neighbours, south borders of the sector and of its north neighbour
+    const size_t borders[6] = {
+        sector * 2,
+        sx > 0 ? (sector - 1) * 2 : none,
+        sx > 0 && sy > 0 ? (sector - sectorsX - 1) * 2 : none,
+        sx > 0 && sy + 1 < sectorsY ? (sector + sectorsX - 1) * 2 : none,
+        sector * 2 + 1,
+        sy > 0 ? (sector - sectorsX) * 2 + 1 : none,
+    };
+
+    for (auto border : borders) {
+        if (border == none)
+            continue;
+
+        for (auto portal : borderPortals[border]) {
+            if (portals[portal].from == sector)
+                exits.push_back(portal);
+            else if (portals[portal].to == sector)
+                entries.push_back(portal);
+        }
+    }
+}
+
+/* Border portals.
+ *
+ * A crossing belongs to the east border of the sector its west cell is in,
+ * diagonals across a corner included, and otherwise to the south border of
+ * the sector its north cell is in. The crossings of a border with the same
+ * direction are cut into chunks of at most PortalWidth crossings, between the
+ * same two sectors, whose cells are connected both ways along the border on
+ * both sides. Every crossing of a chunk therefore reaches and is reached from
+ * the same cells as the middle one, which becomes the portal.
+ */
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::buildBorder (size_t sector, Direction_t dir, std::set<size_t>& touched) {
+    static const Direction_t eastCrossings[3] = {Directions::NORTH_EAST, Directions::EAST, Directions::SOUTH_EAST};
+    static const Direction_t southCrossings[3] = {Directions::SOUTH_WEST, Directions::SOUTH, Directions::SOUTH_EAST};
+
+    const size_t sx = sector % sectorsX;
+    const size_t sy = sector / sectorsX;
+    const bool east = dir == Directions::EAST;
+
+    if ((east && sx + 1 >= sectorsX) || (!east && sy + 1 >= sectorsY))
+        return;
+
+    auto& border = borderPortals[sector * 2 + (east ? 0 : 1)];
+    for (auto portal : border) {
+        touched.insert(portals[portal].from);
+        touched.insert(portals[portal].to);
+    }
+
+    freePortals.insert(freePortals.end(), border.begin(), border.end());
+    border.clear();
+
+    const size_t length = east ? std::min(Size, (size_t)height - sy * Size) : std::min(Size, (size_t)width - sx * Size);
+    const Direction_t along = east ? Directions::SOUTH : Directions::EAST;
+    const Direction_t back = Directions::negateDir(along);
+
+    // Border cell `i` of this sector
+    auto inside = [&](size_t i) -> size_t {
+        return east ? (sy * Size + i) * width + (sx + 1) * Size - 1
+                    : ((sy + 1) * Size - 1) * width + sx * Size + i;
+    };
+
+    for (size_t crossing = 0; crossing < 3; ++crossing) {
+        const Direction_t forward = east ? eastCrossings[crossing] : southCrossings[crossing];
+
+        // Cell across the border from border cell `i`, or -1 if it is off the map or on another border
+        auto across = [&](size_t i) -> size_t {
+            const size_t cellIdx = inside(i);
+            const long x = cellIdx % width + Directions::stepX[forward];
+            const long y = cellIdx / width + Directions::stepY[forward];
+            if (x < 0 || y < 0 || x >= width || y >= height)
+                return -1;
+            if (!east && (size_t)x / Size != sx)
+                return -1;
+
+            return (size_t)y * width + x;
+        };
+
+        auto connected = [&](size_t a, size_t b) -> bool {
+            return canMove(a, b, along) && canMove(b, a, back);
+        };
+
+        for (int reverse = 0; reverse < 2; ++reverse) {
+            const Direction_t move = reverse ? Directions::negateDir(forward) : forward;
+            auto source = [&](size_t i) -> size_t {
+                return reverse ? across(i) : inside(i);
+            };
+            auto target = [&](size_t i) -> size_t {
+                return reverse ? inside(i) : across(i);
+            };
+            auto crossable = [&](size_t i) -> bool {
+                return across(i) != (size_t)(-1) && canMove(source(i), target(i), move);
+            };
+
+            for (size_t i = 0; i < length; ) {
+                if (!crossable(i)) {
+                    ++i;
+                    continue;
+                }
+
+                const size_t from = sectorOf(source(i) % width, source(i) / width);
+                const size_t to = sectorOf(target(i) % width, target(i) / width);
+
+                size_t end = i + 1;
+                while (end < length && end - i < PortalWidth && crossable(end) &&
+                       sectorOf(source(end) % width, source(end) / width) == from &&
+                       sectorOf(target(end) % width, target(end) / width) == to &&
+                       connected(source(end - 1), source(end)) &&
+                       connected(target(end - 1), target(end)))
+                    ++end;
+
+                size_t portal;
+                if (freePortals.empty()) {
+                    portal = portals.size();
+                    portals.push_back(Portal());
+                } else {
+                    portal = freePortals.back();
+                    freePortals.pop_back();
+                }
+
+                const size_t middle = (i + end - 1) / 2;
+                portals[portal].from = from;
+                portals[portal].to = to;
+                portals[portal].dir = move;
+                portals[portal].source = source(middle);
+                portals[portal].target = target(middle);
+                border.push_back(portal);
+
+                touched.insert(from);
+                touched.insert(to);
+                i = end;
+            }
+        }
+    }
+}
+
+/// Distance from every entry portal of a sector to every exit portal, without leaving the sector
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::buildSectorEdges (size_t sector) {
+    std::vector<size_t> exits, entries;
+    sectorPortals(sector, exits, entries);
+
+    auto& edges = sectorEdges[sector];
+    edges.clear();
+
+    std::vector<uint32_t> distance;
+    for (auto exit : exits) {
+        sectorDistances(sector, std::vector<size_t>(1, portals[exit].source), distance);
+
+        for (auto entry : entries) {
+            const auto cellIdx = portals[entry].target;
+            const auto hops = distance[cellIdx % width % Size + (cellIdx / width % Size) * Size];
+
+            if (hops != sectorUnreachable)
+                edges.push_back({entry, exit, hops});
+        }
+    }
+}
+
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::buildPortals () {
+    portals.clear();
+    freePortals.clear();
+
+    std::set<size_t> touched;
+    for (size_t sector = 0; sector < sectorsX * sectorsY; ++sector) {
+        borderPortals[sector * 2].clear();
+        borderPortals[sector * 2 + 1].clear();
+        buildBorder(sector, Directions::EAST, touched);
+        buildBorder(sector, Directions::SOUTH, touched);
+    }
+
+    for (size_t sector = 0; sector < sectorsX * sectorsY; ++sector)
+        buildSectorEdges(sector);
+
+    portalsDirty = false;
+}
+
+/// Hop distance of every cell of a sector to the closest seed, indexed by the position inside the sector
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::sectorDistances (size_t sector, const std::vector<size_t>& seeds, std::vector<uint32_t>& distance) {
+    const Direction_t * directions = Directions::expansionOrder;
+    const long left = (sector % sectorsX) * Size;
+    const long top = (sector / sectorsX) * Size;
+    const long right = std::min(left + (long)Size, (long)width);
+    const long bottom = std::min(top + (long)Size, (long)height);
+
+    // Every cell is queued at most once, so a flat array of local indices is enough
+    distance.assign(Size * Size, sectorUnreachable);
+    std::vector<uint32_t> cellQueue;
+    cellQueue.reserve(Size * Size);
+
+    for (auto cellIdx : seeds) {
+        const uint32_t localIdx = (cellIdx / width - top) * Size + (cellIdx % width - left);
+        distance[localIdx] = 0;
+        cellQueue.push_back(localIdx);
+    }
+
+    for (size_t head = 0; head < cellQueue.size(); ++head) {
+        const auto localIdx = cellQueue[head];
+        const long x = left + localIdx % Size;
+        const long y = top + localIdx / Size;
+        const size_t cellIdx = (size_t)y * width + x;
+
+        for (auto i = 0; directions[i] != Directions::STOP; ++i) {
+            const long nx = x + Directions::stepX[directions[i]];
+            const long ny = y + Directions::stepY[directions[i]];
+            if (nx < left || ny < top || nx >= right || ny >= bottom)
+                continue;
+
+            const uint32_t neighbourLocalIdx = (ny - top) * Size + (nx - left);
+            if (distance[neighbourLocalIdx] != sectorUnreachable)
+                continue;
+
+            if (!canMove((size_t)ny * width + nx, cellIdx, Directions::negateDir(directions[i])))
+                continue;
+
+            distance[neighbourLocalIdx] = distance[localIdx] + 1;
+            cellQueue.push_back(neighbourLocalIdx);
+        }
+    }
+}
+
+/// Dijkstra search on the portal graph, from the points of interest outwards. A portal's distance is the one of its source cell
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::searchPortals (size_t layer) {
+    typedef std::pair<uint32_t, size_t> Entry;
+
+    auto& state = layers[layer];
+    state.portalDistance.assign(portals.size(), sectorUnreachable);
+    state.sectorBuilt.assign(sectorsX * sectorsY, 0);
+    state.builtCount = 0;
+
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> portalQueue;
+
+    // Portals into a sector holding points of interest start at their distance to the closest one
+    std::map<size_t, std::vector<size_t>> goalSectors;
+    for (auto point : state.poi)
+        goalSectors[sectorOf(point[0], point[1])].push_back((size_t)point[1] * width + point[0]);
+
+    std::vector<uint32_t> distance;
+    for (const auto& goals : goalSectors) {
+        std::vector<size_t> exits, entries;
+        sectorPortals(goals.first, exits, entries);
+        sectorDistances(goals.first, goals.second, distance);
+
+        for (auto entry : entries) {
+            const auto cellIdx = portals[entry].target;
+            const auto hops = distance[cellIdx % width % Size + (cellIdx / width % Size) * Size];
+
+            if (hops != sectorUnreachable && hops + 1 < state.portalDistance[entry]) {
+                state.portalDistance[entry] = hops + 1;
+                portalQueue.push({hops + 1, entry});
+            }
+        }
+    }
+
+    while (!portalQueue.empty()) {
+        const auto current = portalQueue.top();
+        portalQueue.pop();
+
+        if (current.first != state.portalDistance[current.second])
+            continue;
+
+        // Portals entering the sector this portal leaves from
+        for (const auto& edge : sectorEdges[portals[current.second].from]) {
+            if (edge.exit != current.second)
+                continue;
+
+            const uint32_t newDistance = current.first + edge.distance + 1;
+            if (newDistance < state.portalDistance[edge.entry]) {
+                state.portalDistance[edge.entry] = newDistance;
+                portalQueue.push({newDistance, edge.entry});
+            }
+        }
+    }
+}
+
+/* Sector expansion.
+ *
+ * Multi-source BFS inside the sector, one distance level at a time. All the
+ * seeds of a level are placed before the level is expanded, so a seed is
+ * only skipped if its cell is at most as far from another seed.
+ */
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::expandSector (size_t sector, std::vector<Seed>& seeds, std::vector<uint32_t>& distance, std::vector<Direction_t> * direction) {
+    const Direction_t * directions = Directions::expansionOrder;
+    const long left = (sector % sectorsX) * Size;
+    const long top = (sector / sectorsX) * Size;
+    const long right = std::min(left + (long)Size, (long)width);
+    const long bottom = std::min(top + (long)Size, (long)height);
+
+    distance.assign(Size * Size, sectorUnreachable);
+    if (direction != nullptr)
+        direction->assign(Size * Size, Directions::STOP);
+
+    std::sort(seeds.begin(), seeds.end());
+
+    // Local indices of the cells at the current and at the next distance
+    std::vector<uint32_t> level, nextLevel;
+    size_t nextSeed = 0;
+    uint32_t current = 0;
+
+    while (nextSeed < seeds.size() || !level.empty()) {
+        if (level.empty())
+            current = std::get<0>(seeds[nextSeed]);
+
+        for (; nextSeed < seeds.size() && std::get<0>(seeds[nextSeed]) == current; ++nextSeed) {
+            const auto cellIdx = std::get<1>(seeds[nextSeed]);
+            const uint32_t localIdx = (cellIdx / width - top) * Size + (cellIdx % width - left);
+            if (distance[localIdx] != sectorUnreachable)
+                continue;
+
+            distance[localIdx] = current;
+            if (direction != nullptr)
+                (*direction)[localIdx] = std::get<2>(seeds[nextSeed]);
+            level.push_back(localIdx);
+        }
+
+        nextLevel.clear();
+        for (auto localIdx : level) {
+            const long x = left + localIdx % Size;
+            const long y = top + localIdx / Size;
+            const size_t cellIdx = (size_t)y * width + x;
+
+            for (auto i = 0; directions[i] != Directions::STOP; ++i) {
+                const long nx = x + Directions::stepX[directions[i]];
+                const long ny = y + Directions::stepY[directions[i]];
+                if (nx < left || ny < top || nx >= right || ny >= bottom)
+                    continue;
+
+                const uint32_t neighbourLocalIdx = (ny - top) * Size + (nx - left);
+                if (distance[neighbourLocalIdx] != sectorUnreachable)
+                    continue;
+
+                const auto dirFromNeighbourToCurrentCell = Directions::negateDir(directions[i]);
+                if (!canMove((size_t)ny * width + nx, cellIdx, dirFromNeighbourToCurrentCell))
+                    continue;
+
+                distance[neighbourLocalIdx] = current + 1;
+                if (direction != nullptr)
+                    (*direction)[neighbourLocalIdx] = dirFromNeighbourToCurrentCell;
+                nextLevel.push_back(neighbourLocalIdx);
+            }
+        }
+
+        level.swap(nextLevel);
+        ++current;
+    }
+}
+
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::baseDistances (size_t layer, size_t sector, std::vector<uint32_t>& distance) {
+    const auto& state = layers[layer];
+
+    std::vector<Seed> seeds;
+    for (auto point : state.poi)
+        if (sectorOf(point[0], point[1]) == sector)
+            seeds.push_back(Seed(0, (size_t)point[1] * width + point[0], Directions::DEST));
+
+    std::vector<size_t> exits, entries;
+    sectorPortals(sector, exits, entries);
+    for (auto exit : exits)
+        if (state.portalDistance[exit] != sectorUnreachable)
+            seeds.push_back(Seed(state.portalDistance[exit], portals[exit].source, portals[exit].dir));
+
+    expandSector(sector, seeds, distance, nullptr);
+}
+
+/* Sector build.
+ *
+ * Points of interest start at distance 0. Every move out of the sector into
+ * a cell with a base distance starts one step further, pointing across the
+ * border. Base distances come from the points of interest and exit portals
+ * of the neighbouring sector alone, so they are never below the distance the
+ * neighbour is built with. The distance therefore strictly decreases along
+ * every route, and every cell the portal graph reaches leads to a point of
+ * interest.
+ */
+template <typename T, size_t L, size_t Size>
+void SectorField_t<T, L, Size>::buildSector (size_t layer, size_t sector) {
+    auto& state = layers[layer];
+    auto& cells = field.cells;
+    const Direction_t * directions = Directions::expansionOrder;
+    const size_t sx = sector % sectorsX;
+    const size_t sy = sector / sectorsX;
+    const long left = sx * Size;
+    const long top = sy * Size;
+    const long right = std::min(left + (long)Size, (long)width);
+    const long bottom = std::min(top + (long)Size, (long)height);
+
+    std::vector<Seed> seeds;
+    for (auto point : state.poi)
+        if (sectorOf(point[0], point[1]) == sector)
+            seeds.push_back(Seed(0, (size_t)point[1] * width + point[0], Directions::DEST));
+
+    // Base distances of the 8 neighbouring sectors, indexed by their offset
+    std::vector<uint32_t> neighbourDistance[9];
+    for (long dy = -1; dy <= 1; ++dy) {
+        for (long dx = -1; dx <= 1; ++dx) {
+            if ((dx == 0 && dy == 0) || (long)sx + dx < 0 || (long)sy + dy < 0 ||
+                (long)sx + dx >= (long)sectorsX || (long)sy + dy >= (long)sectorsY)
+                continue;
+
+            baseDistances(layer, sector + dy * (long)sectorsX + dx, neighbourDistance[(dy + 1) * 3 + dx + 1]);
+        }
+    }
+
+    for (long y = top; y < bottom; ++y) {
+        for (long x = left; x < right; ++x) {
+            // Only the cells along the sector borders can leave it
+            if (x != left && x != right - 1 && y != top && y != bottom - 1)
+                continue;
+
+            for (auto i = 0; directions[i] != Directions::STOP; ++i) {
+                const Direction_t dir = directions[i];
+                const long nx = x + Directions::stepX[dir];
+                const long ny = y + Directions::stepY[dir];
+                if (nx < 0 || ny < 0 || nx >= width || ny >= height || inSector(sector, nx, ny))
+                    continue;
+
+                const long offset = ((ny < top) ? 0 : (ny < bottom) ? 1 : 2) * 3 + ((nx < left) ? 0 : (nx < right) ? 1 : 2);
+                const auto& distance = neighbourDistance[offset];
+                const uint32_t hops = distance[(ny - top - (offset / 3 - 1) * (long)Size) * Size + (nx - left - (offset % 3 - 1) * (long)Size)];
+
+                if (hops != sectorUnreachable && canMove((size_t)y * width + x, (size_t)ny * width + nx, dir))
+                    seeds.push_back(Seed(hops + 1, (size_t)y * width + x, dir));
+            }
+        }
+    }
+
+    std::vector<uint32_t> distance;
+    std::vector<Direction_t> direction;
+    expandSector(sector, seeds, distance, &direction);
+
+    for (long y = top; y < bottom; ++y)
+        for (long x = left; x < right; ++x)
+            cells[(size_t)y * width + x].setDirection(layer, direction[(y - top) * Size + (x - left)]);
+
+    state.sectorBuilt[sector] = 1;
+    ++state.builtCount;
+}
+
+} // namespace flow
+
+#undef NULL_GUARD
+
+#endif // sector_field_cpp
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <array>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "directions.hpp"
+#include "field.hpp"
+#include "planarCells.hpp"
+
+namespace flow {
+    /* Hierarchical flow field for very large maps.
+     *
+     * The map is split into SectorSize x SectorSize sectors. Wherever a sector
+     * border can be crossed, consecutive crossable cells are cut into chunks of
+     * at most PortalWidth cells, and the middle of each chunk becomes a portal.
+     * Portals are connected by the hop distance between them inside each sector.
+     *
+     * Adding points of interest to a layer only runs a coarse Dijkstra search on
+     * this portal graph. The flow field of a sector is built the first time one
+     * of its cells is queried. Its cells lead either to a point of interest or
+     * across the portal with the shortest remaining distance. Build work
+     * therefore grows with the number of sectors in use, not with the map area.
+     *
+     * Portals cover every way across a border: cardinal and diagonal moves,
+     * including moves across a sector corner. A chunk only holds crossings
+     * whose cells are connected along the border on both sides, so the portal
+     * graph reaches exactly the cells a full build of the map reaches.
+     *
+     * A sector is built from its points of interest and from the distances
+     * of the cells across its borders, measured inside their own sector.
+     * Distances therefore strictly decrease along a route, even across
+     * sectors. Routes are not optimal: distances between portals are measured
+     * inside one sector, and from the middle cell of each chunk.
+     *
+     * Queries build sectors, so they write to the field like
+     * addPointOfInterest and updateCells do. A sector field must be used by
+     * one thread at a time, or under a lock of the caller.
+     */
+    template <typename DimensionType, size_t MaxNavLayer, size_t SectorSize = 32>
+    class SectorField_t {
+    public:
+        using FieldType = Field_t<DimensionType, MaxNavLayer, PlanarCells<MaxNavLayer>>;
+        using Vec2 = typename FieldType::Vec2;
+        using PointOfInterests = typename FieldType::PointOfInterests;
+
+    public:
+        SectorField_t (DimensionType _width, DimensionType _height) :
+            width(_width),
+            height(_height),
+            sectorsX((_width + SectorSize - 1) / SectorSize),
+            sectorsY((_height + SectorSize - 1) / SectorSize),
+            portalsDirty(true),
+            field(_width, _height),
+            borderPortals(sectorsX * sectorsY * 2),
+            sectorEdges(sectorsX * sectorsY)
+        {}
+
+        typename FieldType::forward_iterator begin () {
+            return field.begin();
+        }
+
+        typename FieldType::forward_iterator end () {
+            return field.end();
+        }
+
+        /// Get the cell at a coordinate point. Call updateCells after changing its access data once points of interest were added
+        inline typename FieldType::CellType at (DimensionType x, DimensionType y) {
+            return field.at(x, y);
+        }
+
+        /// Set the points of interest of a layer. Only the portal graph is searched, sectors are built when they are queried
+        SectorField_t<DimensionType, MaxNavLayer, SectorSize> * addPointOfInterest (size_t layer, const PointOfInterests& poi);
+
+        /// Recompute the portals around the sectors holding `changedCells` and reset the layers
+        SectorField_t<DimensionType, MaxNavLayer, SectorSize> * updateCells (const std::vector<Vec2>& changedCells);
+
+        /// Get cardinal direction from a coordinate. Builds the sector if needed
+        Direction_t getDirection (size_t layer, DimensionType x, DimensionType y);
+
+        /// Get direction vector from a coordinate. Builds the sector if needed
+        void getDirection (size_t layer, DimensionType x, DimensionType y, float * vX, float * vY);
+
+        /// Get the next cell's coordinate from a coordinate point. Builds the sector if needed
+        void getNextCell (size_t layer, DimensionType x, DimensionType y, DimensionType * nX, DimensionType * nY);
+
+        /// Number of sectors whose flow field was built for a layer
+        size_t builtSectorCount (size_t layer) const {
+            return layers[layer].builtCount;
+        }
+
+        /// Number of portals in the portal graph
+        size_t portalCount () const {
+            return portals.size() - freePortals.size();
+        }
+
+    private:
+        /// Maximum number of border cells served by a portal
+        static const size_t PortalWidth = 8;
+
+        /// A border crossing from `source` in sector `from` to `target` in sector `to`
+        struct Portal {
+            size_t from;
+            size_t to;
+            Direction_t dir;
+            size_t source;
+            size_t target;
+        };
+
+        /// Hop distance inside a sector from the target cell of `entry` to the source cell of `exit`
+        struct InteriorEdge {
+            size_t entry;
+            size_t exit;
+            uint32_t distance;
+        };
+
+        /// Distance, cell and direction a sector build starts from
+        typedef std::tuple<uint32_t, size_t, Direction_t> Seed;
+
+        struct LayerState {
+            PointOfInterests poi;
+            std::vector<uint32_t> portalDistance;
+            std::vector<uint8_t> sectorBuilt;
+            size_t builtCount = 0;
+        };
+
+        DimensionType width;
+        DimensionType height;
+        size_t sectorsX;
+        size_t sectorsY;
+        bool portalsDirty;
+
+        FieldType field;
+
+        std::vector<Portal> portals;
+        std::vector<size_t> freePortals;
+        std::vector<std::vector<size_t>> borderPortals; // Portals of the east (sector * 2) and south (sector * 2 + 1) border of each sector
+        std::vector<std::vector<InteriorEdge>> sectorEdges;
+
+        LayerState layers[MaxNavLayer];
+
+    private:
+        inline size_t sectorOf (size_t x, size_t y) const {
+            return (y / SectorSize) * sectorsX + (x / SectorSize);
+        }
+
+        inline bool inSector (size_t sector, long x, long y) const {
+            const long left = (sector % sectorsX) * SectorSize;
+            const long top = (sector / sectorsX) * SectorSize;
+            return x >= left && y >= top && x < left + (long)SectorSize && y < top + (long)SectorSize && x < width && y < height;
+        }
+
+        bool canMove (size_t fromIdx, size_t toIdx, Direction_t dir);
+
+        /// Collect the portals leaving and entering a sector
+        void sectorPortals (size_t sector, std::vector<size_t>& exits, std::vector<size_t>& entries);
+
+        /// Find the portals of the east or south border of a sector. Sectors of the replaced and new portals are added to `touched`
+        void buildBorder (size_t sector, Direction_t dir, std::set<size_t>& touched);
+        void buildSectorEdges (size_t sector);
+        void buildPortals ();
+
+        void sectorDistances (size_t sector, const std::vector<size_t>& seeds, std::vector<uint32_t>& distance);
+        void searchPortals (size_t layer);
+
+        /// Distance of every cell of a sector from the closest seed, and its direction if `direction` is not null. Indexed by the position inside the sector
+        void expandSector (size_t sector, std::vector<Seed>& seeds, std::vector<uint32_t>& distance, std::vector<Direction_t> * direction);
+
+        /// Distances inside a sector from its points of interest and exit portals
+        void baseDistances (size_t layer, size_t sector, std::vector<uint32_t>& distance);
+        void buildSector (size_t layer, size_t sector);
+    };
+
+    template <size_t MaxNavLayer, size_t SectorSize = 32>
+    using LayeredSectorField = SectorField_t<uint16_t, MaxNavLayer, SectorSize>;
+
+    using SectorField = LayeredSectorField<1>;
+}
+
+#include "sectorField.cpp"
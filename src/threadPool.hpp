@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace flow {
+    class ThreadPool {
+    public:
+        /// Task executed by every worker. The argument is the worker index in [0, size())
+        using Task = std::function<void(size_t)>;
+
+    public:
+        /// Create a pool with `threadCount` workers. The calling thread counts as worker 0
+        explicit ThreadPool (size_t threadCount = std::thread::hardware_concurrency()) :
+            generation(0),
+            pending(0),
+            stopping(false)
+        {
+            if (threadCount == 0)
+                threadCount = 1;
+
+            for (size_t i = 1; i < threadCount; ++i)
+                workers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+
+        ~ThreadPool () {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+
+            for (auto& worker : workers)
+                worker.join();
+        }
+
+        ThreadPool (const ThreadPool&) = delete;
+        ThreadPool& operator= (const ThreadPool&) = delete;
+
+        /// Number of workers, including the calling thread
+        size_t size () const {
+            return workers.size() + 1;
+        }
+
+        /* Run `task` once on every worker and block until all of them have returned.
+         *
+         * Workers are always waited for, even if the task throws on the calling
+         * thread. An exception thrown by a worker is rethrown here; when several
+         * workers throw, the one of the calling thread wins, then the first one
+         * caught.
+         */
+        void run (const Task& task) {
+            if (workers.empty()) {
+                task(0);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                current = &task;
+                pending = workers.size();
+                failure = nullptr;
+                ++generation;
+            }
+            wake.notify_all();
+
+            std::exception_ptr callerFailure;
+            try {
+                task(0);
+            } catch (...) {
+                callerFailure = std::current_exception();
+            }
+
+            std::exception_ptr workerFailure;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [this] { return pending == 0; });
+                current = nullptr;
+                workerFailure = failure;
+                failure = nullptr;
+            }
+
+            if (callerFailure)
+                std::rethrow_exception(callerFailure);
+            if (workerFailure)
+                std::rethrow_exception(workerFailure);
+        }
+
+    private:
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        const Task * current = nullptr;
+        std::exception_ptr failure; // First exception thrown by a worker during the current run
+        uint64_t generation;
+        size_t pending;
+        bool stopping;
+
+    private:
+        void workerLoop (size_t workerIdx) {
+            uint64_t seenGeneration = 0;
+
+            while (true) {
+                const Task * task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+
+                    if (stopping)
+                        return;
+
+                    seenGeneration = generation;
+                    task = current;
+                }
+
+                std::exception_ptr taskFailure;
+                try {
+                    (*task)(workerIdx);
+                } catch (...) {
+                    taskFailure = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (taskFailure && !failure)
+                    failure = taskFailure;
+
+                if (--pending == 0)
+                    done.notify_one();
+            }
+        }
+    };
+}
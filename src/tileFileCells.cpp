@@ -0,0 +1,287 @@
+#include "tileFileCells.hpp"
+
+#ifndef tile_file_cells_cpp
+#define tile_file_cells_cpp
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "cellChecks.hpp"
+
+#define setDirectionMap(existing, newVal) ((existing & 0xF0) + (newVal & 0x0F))
+
+namespace flow {
+
+template <size_t L, size_t N>
+Direction_t TileFileCell<L, N>::getDirection (size_t layer) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    return direction(layer) & 0x0F;
+}
+
+template <size_t L, size_t N>
+void TileFileCell<L, N>::setDirection (size_t layer, Direction_t newDirection) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    uint8_t& byte = direction(layer);
+    byte = setDirectionMap(byte, newDirection);
+}
+
+template <size_t L, size_t N>
+void TileFileCell<L, N>::markDirAsWall (size_t layer) {
+    setDirection(layer, Directions::WALL);
+}
+
+template <size_t L, size_t N>
+void TileFileCell<L, N>::markDirAsStop (size_t layer) {
+    setDirection(layer, Directions::STOP);
+}
+
+template <size_t L, size_t N>
+void TileFileCell<L, N>::setBuildId (size_t layer, uint8_t buildId) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    uint8_t& byte = direction(layer);
+    byte = (buildId << 4) + (byte & 0xF);
+}
+
+template <size_t L, size_t N>
+uint8_t TileFileCell<L, N>::getBuildId (size_t layer) {
+    FLOW_VALIDATE_LAYER(layer);
+
+    return (direction(layer) >> 4);
+}
+
+template <size_t L, size_t N>
+bool TileFileCell<L, N>::canEnterFrom (Direction_t dir) {
+    auto entryWhitelist = getEntryDir();
+
+    const bool passFilter = (entryWhitelist & dir) != 0;
+    const bool passInvFilter = ((~entryWhitelist) & dir) == 0;
+    return (passFilter && passInvFilter);
+}
+
+template <size_t L, size_t N>
+TileFileCells<L, N>::TileFileCells (size_t _cellCount, const std::string& path, size_t _residentTiles) :
+    cellCount(_cellCount),
+    tileCount(_cellCount / tileCells),
+    tileStride(0),
+    maxResident(_residentTiles),
+    fd(-1),
+    slotOfTile(),
+    initialized(),
+    tileEvents(),
+    events(0),
+    slots(),
+    newest(NO_SLOT),
+    oldest(NO_SLOT),
+    lastTile((size_t)(-1)),
+    lastBase(nullptr),
+    loads(0)
+{
+    if (_cellCount % tileCells != 0)
+        throw std::invalid_argument("Cell count is not a whole number of tiles, use TiledLayout with the same tile size");
+
+    if (_residentTiles == 0 || _residentTiles >= NO_SLOT)
+        throw std::invalid_argument("Resident tile count out of range");
+
+    if (tileCount >= NO_SLOT)
+        throw std::invalid_argument("Too many tiles, use a larger tile size");
+
+    // Tiles are mapped one by one, so each starts on a page boundary
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    tileStride = (tileCells * (2 + L) + page - 1) / page * page;
+
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+
+    // The open descriptor keeps the file alive until the storage closes it
+    ::unlink(path.c_str());
+
+    if (ftruncate(fd, (off_t)(tileCount * tileStride)) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot allocate " + path);
+    }
+
+    slotOfTile.assign(tileCount, (uint32_t)NO_SLOT);
+    initialized.assign(tileCount, false);
+    tileEvents.assign(tileCount, 0);
+    std::fill(clearEvents, clearEvents + L, 0);
+    slots.reserve(std::min(maxResident, tileCount));
+}
+
+template <size_t L, size_t N>
+TileFileCells<L, N>::~TileFileCells () {
+    for (const auto& slot : slots)
+        munmap(slot.base, tileStride);
+
+    close(fd);
+}
+
+template <size_t L, size_t N>
+uint8_t * TileFileCells<L, N>::load (size_t tile) {
+    uint32_t slot = slotOfTile[tile];
+
+    if (slot != NO_SLOT) {
+        if (slot != newest) {
+            detach(slot);
+            pushNewest(slot);
+        }
+    } else {
+        void * base = mmap(nullptr, tileStride, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)(tile * tileStride));
+        if (base == MAP_FAILED)
+            throw std::runtime_error("Cannot map a tile");
+
+        if (slots.size() < maxResident) {
+            slot = (uint32_t)slots.size();
+            slots.push_back(Slot());
+        } else {
+            // Reuse the slot of the least recently used tile
+            slot = oldest;
+            detach(slot);
+            munmap(slots[slot].base, tileStride);
+            slotOfTile[slots[slot].tile] = NO_SLOT;
+            tileEvents[slots[slot].tile] = ++events;
+        }
+
+        slots[slot].tile = tile;
+        slots[slot].base = (uint8_t *)base;
+        slotOfTile[tile] = slot;
+        tileEvents[tile] = ++events;
+        pushNewest(slot);
+        ++loads;
+
+        // The file reads as zeros: walls, which still need the default cost
+        if (!initialized[tile]) {
+            std::fill(slots[slot].base + tileCells, slots[slot].base + 2 * tileCells, 1);
+            initialized[tile] = true;
+        }
+    }
+
+    lastTile = tile;
+    lastBase = slots[slot].base;
+    return lastBase;
+}
+
+template <size_t L, size_t N>
+void TileFileCells<L, N>::detach (uint32_t slot) {
+    const uint32_t newer = slots[slot].newer;
+    const uint32_t older = slots[slot].older;
+
+    if (newer != NO_SLOT)
+        slots[newer].older = older;
+    else
+        newest = older;
+
+    if (older != NO_SLOT)
+        slots[older].newer = newer;
+    else
+        oldest = newer;
+}
+
+template <size_t L, size_t N>
+void TileFileCells<L, N>::pushNewest (uint32_t slot) {
+    slots[slot].newer = NO_SLOT;
+    slots[slot].older = newest;
+
+    if (newest != NO_SLOT)
+        slots[newest].newer = slot;
+    newest = slot;
+
+    if (oldest == NO_SLOT)
+        oldest = slot;
+}
+
+template <size_t L, size_t N>
+void TileFileCells<L, N>::evictAll () {
+    for (const auto& slot : slots) {
+        munmap(slot.base, tileStride);
+        slotOfTile[slot.tile] = NO_SLOT;
+        tileEvents[slot.tile] = ++events;
+    }
+
+    slots.clear();
+    newest = oldest = NO_SLOT;
+    lastTile = (size_t)(-1);
+    lastBase = nullptr;
+}
+
+/* Build ID reset.
+ *
+ * A tile can only hold build IDs if it was resident at some point since the
+ * previous reset: when it was mapped or unmapped after that reset, or if it
+ * is still resident. Only those tiles are loaded and reset, so a reset costs
+ * about the tiles the builds in between touched, not a pass over the file.
+ */
+template <size_t L, size_t N>
+void TileFileCells<L, N>::clearBuildIds (size_t layer) {
+    for (size_t tile = 0; tile < tileCount; ++tile) {
+        if (slotOfTile[tile] == NO_SLOT && tileEvents[tile] <= clearEvents[layer])
+            continue;
+
+        uint8_t * plane = load(tile) + (2 + layer) * tileCells;
+        for (size_t i = 0; i < tileCells; ++i)
+            plane[i] &= 0x0F;
+    }
+
+    clearEvents[layer] = events;
+}
+
+template <size_t L, size_t N>
+template <typename Fn>
+void TileFileCells<L, N>::forEachPiece (size_t first, size_t count, Fn fn) {
+    size_t done = 0;
+    while (done < count) {
+        const size_t idx = first + done;
+        const size_t offset = idx % tileCells;
+        const size_t piece = std::min(count - done, tileCells - offset);
+
+        uint8_t * base = idx / tileCells == lastTile ? lastBase : load(idx / tileCells);
+        fn(base, offset, piece, done);
+        done += piece;
+    }
+}
+
+/// Set the access data of `count` cells from `first` to `in[i]`, or to `lookup[in[i]]` with a lookup table
+template <size_t L, size_t N>
+void TileFileCells<L, N>::writeAccess (size_t first, size_t count, const uint8_t * in, const uint8_t * lookup) {
+    forEachPiece(first, count, [&](uint8_t * base, size_t offset, size_t piece, size_t done) {
+        uint8_t * out = base + offset;
+        for (size_t i = 0; i < piece; ++i)
+            out[i] = (lookup != nullptr ? lookup[in[done + i]] : in[done + i]) & ACCESS_MASK;
+    });
+}
+
+template <size_t L, size_t N>
+void TileFileCells<L, N>::readAccess (size_t first, size_t count, uint8_t * out) const {
+    // Loading a tile only changes the resident set, not the cells
+    const_cast<TileFileCells *>(this)->forEachPiece(first, count, [&](uint8_t * base, size_t offset, size_t piece, size_t done) {
+        std::copy(base + offset, base + offset + piece, out + done);
+    });
+}
+
+template <size_t L, size_t N>
+void TileFileCells<L, N>::writeCosts (size_t first, size_t count, const uint8_t * in) {
+    forEachPiece(first, count, [&](uint8_t * base, size_t offset, size_t piece, size_t done) {
+        std::copy(in + done, in + done + piece, base + tileCells + offset);
+    });
+}
+
+template <size_t L, size_t N>
+void TileFileCells<L, N>::readCosts (size_t first, size_t count, uint8_t * out) const {
+    const_cast<TileFileCells *>(this)->forEachPiece(first, count, [&](uint8_t * base, size_t offset, size_t piece, size_t done) {
+        std::copy(base + tileCells + offset, base + tileCells + offset + piece, out + done);
+    });
+}
+
+} // namespace flow
+
+#undef setDirectionMap
+
+#endif // tile_file_cells_cpp
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <string>
+#include <vector>
+
+#include "directions.hpp"
+
+namespace flow {
+    template <size_t maxNavLayer, size_t TileSize>
+    class TileFileCells;
+
+    template <size_t maxNavLayer, size_t TileSize>
+    class TileFileCellPointer;
+
+    /* Handle to a single cell of a TileFileCells storage. Offers the same
+     * interface as FieldCell. Every call goes through the storage, which
+     * loads the tile of the cell if it is not resident, so a handle stays valid
+     * whatever other cells are accessed in the meantime.
+     */
+    template <size_t maxNavLayer, size_t TileSize>
+    class TileFileCell {
+        template <typename T, size_t S, typename C, typename G>
+        friend class Field_t;
+
+        friend class TileFileCells<maxNavLayer, TileSize>;
+        friend class TileFileCellPointer<maxNavLayer, TileSize>;
+
+    public:
+        size_t getMaxNavLayer () {
+            return maxNavLayer;
+        }
+
+        Direction_t getDirection (size_t layer);
+
+        void setEntryDir (Direction_t direction) {
+            uint8_t& access = plane(ACCESS_PLANE);
+            access = (access & 0xF0) | direction;
+        }
+
+        Direction_t getEntryDir () {
+            return plane(ACCESS_PLANE) & 0xF;
+        }
+
+        void setAllowDiagonal (bool allowDiag) {
+            uint8_t& access = plane(ACCESS_PLANE);
+            access = (access & ~0x10) | (allowDiag ? 0x10 : 0);
+        }
+
+        bool getAllowDiagonal () {
+            return (plane(ACCESS_PLANE) & 0x10) != 0;
+        }
+
+        bool isWall () {
+            return getEntryDir() == Directions::WALL;
+        }
+
+        /// Cost of moving out of this cell, used by the weighted build mode. 1 (default) to 255
+        void setCost (uint8_t cost) {
+            plane(COST_PLANE) = cost;
+        }
+
+        uint8_t getCost () {
+            return plane(COST_PLANE);
+        }
+
+    private:
+        static const size_t ACCESS_PLANE = 0;
+        static const size_t COST_PLANE = 1;
+
+        TileFileCells<maxNavLayer, TileSize> * storage;
+        size_t idx;
+
+    private:
+        TileFileCell (TileFileCells<maxNavLayer, TileSize> * _storage, size_t _idx) :
+            storage(_storage),
+            idx(_idx)
+        {}
+
+        inline uint8_t& plane (size_t p) {
+            return storage->byteAt(idx, p);
+        }
+
+        inline uint8_t& direction (size_t layer) {
+            return storage->byteAt(idx, 2 + layer);
+        }
+
+        void setDirection (size_t layer, Direction_t direction);
+        void markDirAsWall (size_t layer);
+        void markDirAsStop (size_t layer);
+        bool canEnterFrom (Direction_t dir);
+
+        void setBuildId (size_t layer, uint8_t buildId);
+        uint8_t getBuildId (size_t layer);
+
+        inline void setCellAsDest (size_t layer) {
+            markDirAsStop(layer);
+        }
+
+        inline size_t maxLayer () {
+            return maxNavLayer;
+        }
+    };
+
+    /// Pointer-like wrapper around a TileFileCell, used by the field iterator
+    template <size_t maxNavLayer, size_t TileSize>
+    class TileFileCellPointer {
+    public:
+        TileFileCellPointer (TileFileCells<maxNavLayer, TileSize> * storage, size_t idx) :
+            cell(storage, idx)
+        {}
+
+        TileFileCell<maxNavLayer, TileSize>& operator* () const { return cell; }
+        TileFileCell<maxNavLayer, TileSize> * operator-> () const { return &cell; }
+
+        TileFileCellPointer& operator++ () { ++cell.idx; return *this; }
+
+        bool operator== (const TileFileCellPointer& other) const { return cell.idx == other.cell.idx && cell.storage == other.cell.storage; };
+        bool operator!= (const TileFileCellPointer& other) const { return !(*this == other); };
+
+    private:
+        mutable TileFileCell<maxNavLayer, TileSize> cell;
+    };
+
+    /* Disk-backed cell storage for maps larger than memory.
+     *
+     * Cells are stored in TileSize x TileSize tiles, in the order of
+     * TiledLayout<TileSize>, which this storage must be used with (see
+     * StreamedLayeredField). Every tile holds the planes of PlanarCells for its
+     * cells (access, cost, one direction plane per layer) and starts on a page
+     * boundary of a scratch file. Tiles are memory mapped when a cell of theirs
+     * is accessed, and at most `residentTiles` are mapped at once: the least
+     * recently used one is unmapped to make room, and the OS writes it back to
+     * the file. The memory of the process therefore stays around
+     * residentTiles * tileBytes(), however large the map, and the page cache
+     * holds as much of the rest as the machine can spare.
+     *
+     * The file is created (or truncated) by the constructor and removed from
+     * its directory straight away, so it only lives as long as the storage,
+     * even if the process is killed. It starts sparse: tiles take disk space
+     * once they are written. New cells are walls, like those of PlanarCells.
+     *
+     * A storage is not thread safe: the field must be built and queried by one
+     * thread at a time. Batch queries, sampling, crowds and field files read
+     * the direction planes directly and need an in-memory storage.
+     */
+    template <size_t maxNavLayer, size_t TileSize = 256>
+    class TileFileCells {
+        static_assert(maxNavLayer > 0, "Tile files need a layer count known at compile time");
+
+        friend class TileFileCell<maxNavLayer, TileSize>;
+
+    public:
+        using value_type = TileFileCell<maxNavLayer, TileSize>;
+        using reference  = value_type;
+        using pointer    = TileFileCellPointer<maxNavLayer, TileSize>;
+
+        /// Cells are loaded tile by tile, see Field_t::buildStreamed
+        static const bool streamed = true;
+
+        static const size_t tileCells = TileSize * TileSize;
+
+    public:
+        /// Cells stored in a new scratch file at `path`, with at most `_residentTiles` tiles in memory
+        TileFileCells (size_t _cellCount, const std::string& path, size_t _residentTiles = 64);
+        ~TileFileCells ();
+
+        TileFileCells (const TileFileCells&) = delete;
+        TileFileCells& operator= (const TileFileCells&) = delete;
+
+        inline reference operator[] (size_t idx) {
+            return value_type(this, idx);
+        }
+
+        inline value_type operator[] (size_t idx) const {
+            return value_type(const_cast<TileFileCells *>(this), idx);
+        }
+
+        /// Pointer to a cell, used by the field iterator
+        inline pointer address (size_t idx) {
+            return pointer(this, idx);
+        }
+
+        inline size_t size () const {
+            return cellCount;
+        }
+
+        inline size_t layerCount () const {
+            return maxNavLayer;
+        }
+
+        /// Bytes of memory used: the resident tiles and the tile table, not the file
+        inline size_t memoryUsage () const {
+            return slots.size() * tileBytes() + slotOfTile.size() * (sizeof(uint32_t) + sizeof(uint64_t)) + slots.size() * sizeof(Slot);
+        }
+
+        /// Bytes of a tile in the file and in memory, a whole number of pages
+        inline size_t tileBytes () const {
+            return tileStride;
+        }
+
+        inline size_t residentTiles () const {
+            return maxResident;
+        }
+
+        /// Tiles mapped since the storage was created. Grows by about one per tile access once the working set no longer fits
+        inline uint64_t tileLoads () const {
+            return loads;
+        }
+
+        /// Write the resident tiles back to the file and unmap them
+        void evictAll ();
+
+        void writeAccess (size_t first, size_t count, const uint8_t * in, const uint8_t * lookup);
+        void readAccess (size_t first, size_t count, uint8_t * out) const;
+        void writeCosts (size_t first, size_t count, const uint8_t * in);
+        void readCosts (size_t first, size_t count, uint8_t * out) const;
+
+        /// Reset the build ID of every cell of a layer to 0, see Field_t::nextBuildId. Only the tiles mapped since the previous reset of the layer are loaded
+        void clearBuildIds (size_t layer);
+
+    private:
+        static const uint32_t NO_SLOT = (uint32_t)(-1);
+
+        /// A resident tile, in a doubly linked list from the most to the least recently used
+        struct Slot {
+            size_t tile;
+            uint8_t * base;
+            uint32_t newer;
+            uint32_t older;
+        };
+
+        size_t cellCount;
+        size_t tileCount;
+        size_t tileStride;
+        size_t maxResident;
+        int fd;
+
+        std::vector<uint32_t> slotOfTile; // NO_SLOT unless the tile is resident
+        std::vector<bool> initialized;    // Tiles whose cost plane was filled with the default cost
+        std::vector<uint64_t> tileEvents; // Value of `events` when each tile was last mapped or unmapped
+        uint64_t clearEvents[maxNavLayer]; // Value of `events` after the latest clearBuildIds of each layer
+        uint64_t events;
+        std::vector<Slot> slots;
+        uint32_t newest;
+        uint32_t oldest;
+
+        // The tile of the latest access, which most accesses hit again
+        size_t lastTile;
+        uint8_t * lastBase;
+
+        uint64_t loads;
+
+    private:
+        inline uint8_t& byteAt (size_t idx, size_t plane) {
+            const size_t tile = idx / tileCells;
+            uint8_t * base = tile == lastTile ? lastBase : load(tile);
+            return base[plane * tileCells + idx % tileCells];
+        }
+
+        /// Base address of a tile, mapped if needed, and marked as the most recently used
+        uint8_t * load (size_t tile);
+
+        void detach (uint32_t slot);
+        void pushNewest (uint32_t slot);
+
+        /// Call fn(tile base, offset in the tile, cells, position in the run) for the pieces of a run of cells split at tile edges
+        template <typename Fn>
+        void forEachPiece (size_t first, size_t count, Fn fn);
+    };
+}
+
+#include "tileFileCells.cpp"